@@ -1,3 +1,4 @@
+#pragma once
 #include <vector>
 #include <cstdint>
 #include <fstream>
@@ -5,6 +6,10 @@
 #include <cmath>
 #include <iostream>
 #include <array>
+#include <limits>
+#include <span>
+
+#include "parallel.h"
 
 const double VagLutDecoder[5][2] = {
     {0.0, 0.0},               // 0
@@ -20,7 +25,7 @@ struct VAGChunk {
     uint8_t sample[14];
 };
 
-std::vector<uint8_t> EncodeAdpcm1(const std::vector<int16_t>& pcmData, int numChannels = 1)
+std::vector<uint8_t> EncodeAdpcm1(std::span<const int16_t> pcmData, int numChannels = 1)
 {
     const int samplesPerChunk = 28;
     std::vector<uint8_t> output;
@@ -247,3 +252,465 @@ std::vector<int16_t> DecodeAdpcm1(
 
     return pcmData;
 }
+
+
+// ------
+// Integer decoder, same arithmetic as the SPU2: Q6 coefficients, shifts instead of pow()
+// and a history that is clamped to 16 bits like the hardware output.
+const int VagLutFixed[5][2] = {
+    {0, 0},
+    {60, 0},
+    {115, -52},
+    {98, -55},
+    {122, -60}
+};
+
+struct Adpcm1State {
+    int hist_1 = 0;
+    int hist_2 = 0;
+};
+
+// Decodes one 16-byte frame into 28 samples
+inline void DecodeAdpcm1Frame(const uint8_t* frame, int16_t* out, Adpcm1State& state)
+{
+    int shift = frame[0] & 0x0F;
+    if (shift > 12)
+        shift = 9;      // what the SPU2 does with the unused shift values
+    const int predict = std::min(frame[0] >> 4, 4);
+    const int coef_1 = VagLutFixed[predict][0];
+    const int coef_2 = VagLutFixed[predict][1];
+
+    int hist_1 = state.hist_1, hist_2 = state.hist_2;
+    for (int j = 0; j < 14; ++j) {
+        const uint8_t byte = frame[2 + j];
+        // place the nibble in the top of an int16 so it sign-extends, then scale down
+        const int nibbles[2] = {
+            int16_t((byte & 0x0F) << 12) >> shift,
+            int16_t((byte & 0xF0) << 8) >> shift,
+        };
+        for (int n = 0; n < 2; ++n) {
+            int sample = nibbles[n] + ((hist_1 * coef_1 + hist_2 * coef_2) >> 6);
+            sample = std::clamp(sample, -32768, 32767);
+            hist_2 = hist_1;
+            hist_1 = sample;
+            *out++ = static_cast<int16_t>(sample);
+        }
+    }
+    state.hist_1 = hist_1;
+    state.hist_2 = hist_2;
+}
+
+// Number of samples DecodeAdpcm1Fixed() produces: every frame after the header up to the end flag
+inline size_t Adpcm1DecodedSamples(std::span<const uint8_t> vagData)
+{
+    size_t frames = 0;
+    for (size_t pos = 16; pos + 16 <= vagData.size() && vagData[pos + 1] != 0x03; pos += 16)
+        ++frames;
+    return frames * 28;
+}
+
+// Decodes into a caller-provided buffer of at least Adpcm1DecodedSamples() samples, returns the samples written
+inline size_t DecodeAdpcm1Fixed(std::span<const uint8_t> vagData, std::span<int16_t> out, Adpcm1State& state)
+{
+    size_t written = 0;
+    for (size_t pos = 16; pos + 16 <= vagData.size() && written + 28 <= out.size(); pos += 16) {
+        if (vagData[pos + 1] == 0x03)
+            break;
+        DecodeAdpcm1Frame(&vagData[pos], out.data() + written, state);
+        written += 28;
+    }
+    return written;
+}
+
+inline std::vector<int16_t> DecodeAdpcm1Fixed(std::span<const uint8_t> vagData)
+{
+    std::vector<int16_t> pcmData(Adpcm1DecodedSamples(vagData));
+    Adpcm1State state;
+    DecodeAdpcm1Fixed(vagData, pcmData, state);
+    return pcmData;
+}
+
+
+// ------
+// Encoder presets. All of them share one frame search that runs a set of candidate shifts
+// for a predictor in lock-step (one lane per shift) and drops the predictor as soon as every
+// lane is already worse than the best frame found so far.
+enum class Adpcm1Quality {
+    Fast,           // one predictor picked from the source signal, two shifts around its estimate
+    Normal,         // every predictor, three shifts around its estimate
+    Exhaustive,     // every predictor and shift, picks the same frames as EncodeAdpcm1()
+};
+
+struct Adpcm1Scales {
+    double scale[13];   // 2^shift
+    double step[13];    // 4096 / 2^shift
+
+    Adpcm1Scales() {
+        for (int shift = 0; shift <= 12; ++shift) {
+            scale[shift] = std::pow(2.0, shift);
+            step[shift] = 4096.0 / scale[shift];
+        }
+    }
+};
+
+inline const Adpcm1Scales& GetAdpcm1Scales()
+{
+    static const Adpcm1Scales scales;
+    return scales;
+}
+
+struct Adpcm1Frame {
+    double error = std::numeric_limits<double>::max();
+    int predict = 0;
+    int shift = 0;
+    double hist_1 = 0.0, hist_2 = 0.0;  // encoder history after this frame
+    std::array<int8_t, 28> quantized{};
+};
+
+// Closed-loop trial of one predictor with up to 13 shifts, updates best if one of them beats it
+inline void Adpcm1TryShifts(const int16_t* src, size_t stride, double hist_1, double hist_2,
+                            int predict, const int* shifts, int num_shifts, Adpcm1Frame& best)
+{
+    const auto& scales = GetAdpcm1Scales();
+    const double coef_1 = VagLutDecoder[predict][0];
+    const double coef_2 = VagLutDecoder[predict][1];
+
+    double scale[13], step[13], h1[13], h2[13], error[13];
+    int8_t quantized[28][13];
+    for (int l = 0; l < num_shifts; ++l) {
+        scale[l] = scales.scale[shifts[l]];
+        step[l] = scales.step[shifts[l]];
+        h1[l] = hist_1;
+        h2[l] = hist_2;
+        error[l] = 0.0;
+    }
+
+    for (int i = 0; i < 28; ++i) {
+        const double sample = src[i * stride];
+        for (int l = 0; l < num_shifts; ++l) {
+            double predicted = h1[l] * coef_1 + h2[l] * coef_2;
+            double scaled = (sample - predicted) * scale[l] / 4096.0;
+            double q = std::clamp(std::nearbyint(scaled), -8.0, 7.0);
+            double recon = predicted + q * step[l];
+            error[l] += (sample - recon) * (sample - recon);
+            quantized[i][l] = static_cast<int8_t>(q);
+            h2[l] = h1[l];
+            h1[l] = recon;
+        }
+
+        // errors only grow, stop once no lane can win anymore
+        if ((i & 3) == 3 && *std::min_element(error, error + num_shifts) >= best.error)
+            return;
+    }
+
+    for (int l = 0; l < num_shifts; ++l) {
+        if (error[l] < best.error) {
+            best.error = error[l];
+            best.predict = predict;
+            best.shift = shifts[l];
+            best.hist_1 = h1[l];
+            best.hist_2 = h2[l];
+            for (int i = 0; i < 28; ++i)
+                best.quantized[i] = quantized[i][l];
+        }
+    }
+}
+
+// Open-loop estimate for one predictor: the largest shift that keeps the source residual in 4 bits
+inline int Adpcm1EstimateShift(const int16_t* src, size_t stride, double hist_1, double hist_2, int predict, double& peak)
+{
+    const auto& scales = GetAdpcm1Scales();
+    peak = 0.0;
+    for (int i = 0; i < 28; ++i) {
+        const double sample = src[i * stride];
+        const double predicted = hist_1 * VagLutDecoder[predict][0] + hist_2 * VagLutDecoder[predict][1];
+        peak = std::max(peak, std::abs(sample - predicted));
+        hist_2 = hist_1;
+        hist_1 = sample;
+    }
+
+    int shift = 12;
+    while (shift > 0 && peak * scales.scale[shift] / 4096.0 > 7.5)
+        --shift;
+    return shift;
+}
+
+inline Adpcm1Frame Adpcm1SearchFrame(const int16_t* src, size_t stride, double hist_1, double hist_2, Adpcm1Quality quality)
+{
+    Adpcm1Frame best;
+
+    if (quality == Adpcm1Quality::Exhaustive) {
+        static const int all_shifts[13] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+        for (int predict = 0; predict <= 4; ++predict)
+            Adpcm1TryShifts(src, stride, hist_1, hist_2, predict, all_shifts, 13, best);
+        return best;
+    }
+
+    int estimate[5];
+    double peak[5];
+    for (int predict = 0; predict <= 4; ++predict)
+        estimate[predict] = Adpcm1EstimateShift(src, stride, hist_1, hist_2, predict, peak[predict]);
+
+    // the closed loop can overshoot the open-loop residual, so also try one shift coarser
+    auto try_around = [&](int predict, int below, int above) {
+        int shifts[3], n = 0;
+        for (int shift = estimate[predict] - below; shift <= estimate[predict] + above; ++shift)
+            if (shift >= 0 && shift <= 12)
+                shifts[n++] = shift;
+        Adpcm1TryShifts(src, stride, hist_1, hist_2, predict, shifts, n, best);
+    };
+
+    if (quality == Adpcm1Quality::Fast) {
+        const int predict = int(std::min_element(peak, peak + 5) - peak);
+        try_around(predict, 1, 0);
+    }
+    else {
+        for (int predict = 0; predict <= 4; ++predict)
+            try_around(predict, 1, 1);
+    }
+    return best;
+}
+
+// exact size the encoders below produce: a trailing partial frame is dropped (same framing as
+// EncodeAdpcm1()), then one end frame per channel
+inline size_t Adpcm1EncodedSize(size_t frames, int numChannels)
+{
+    if (frames == 0 || numChannels <= 0)
+        return 0;
+    return (frames / 28 + 1) * size_t(numChannels) * 16;
+}
+
+// Encodes into a caller buffer of at least Adpcm1EncodedSize() bytes, returns the bytes written
+size_t EncodeAdpcm1(std::span<const int16_t> pcmData, int numChannels, Adpcm1Quality quality, std::span<uint8_t> output)
+{
+    const int samplesPerChunk = 28;
+    if (numChannels <= 0)
+        return 0;
+
+    const size_t totalSamples = pcmData.size() / numChannels;
+    const size_t numFrames = totalSamples / samplesPerChunk;
+    const size_t size = Adpcm1EncodedSize(totalSamples, numChannels);
+    if (!size || output.size() < size)
+        return 0;
+
+    std::vector<double> hist_1(numChannels, 0.0);
+    std::vector<double> hist_2(numChannels, 0.0);
+
+    uint8_t* out = output.data();
+    for (size_t frame = 0; frame < numFrames; ++frame) {
+        for (int ch = 0; ch < numChannels; ++ch) {
+            const int16_t* src = pcmData.data() + frame * samplesPerChunk * numChannels + ch;
+            const Adpcm1Frame best = Adpcm1SearchFrame(src, numChannels, hist_1[ch], hist_2[ch], quality);
+
+            *out++ = uint8_t((best.predict << 4) | (best.shift & 0x0F));
+            *out++ = 0x00;
+            for (int i = 0; i < 14; ++i)
+                *out++ = uint8_t(((best.quantized[i * 2 + 1] & 0x0F) << 4) | (best.quantized[i * 2] & 0x0F));
+
+            hist_1[ch] = best.hist_1;
+            hist_2[ch] = best.hist_2;
+        }
+    }
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+        *out++ = 0x00;      // predict/shift
+        *out++ = 0x03;      // flags
+        out = std::fill_n(out, 14, uint8_t(0x00));
+    }
+    return size;
+}
+
+std::vector<uint8_t> EncodeAdpcm1(std::span<const int16_t> pcmData, int numChannels, Adpcm1Quality quality)
+{
+    std::vector<uint8_t> output(Adpcm1EncodedSize(pcmData.size() / std::max(numChannels, 1), numChannels));
+    output.resize(EncodeAdpcm1(pcmData, numChannels, quality, std::span<uint8_t>(output)));
+    return output;
+}
+
+
+// ------
+// Segmented encoding for long tracks. Every segment starts from a history taken from the source
+// signal and is encoded on its own thread. Afterwards the seams are walked in order: the first
+// seam_frames frames of each segment are searched again from the real history left by the
+// previous segment, and the rest of the segment is replayed to carry that history forward.
+inline void Adpcm1ReplayFrame(const uint8_t* frame, double& hist_1, double& hist_2)
+{
+    const auto& scales = GetAdpcm1Scales();
+    const int predict = std::min(frame[0] >> 4, 4);
+    const int shift = std::min(frame[0] & 0x0F, 12);
+    for (int i = 0; i < 28; ++i) {
+        const uint8_t byte = frame[2 + i / 2];
+        int q = (i & 1) ? (byte >> 4) : (byte & 0x0F);
+        if (q & 0x08) q -= 16;
+        const double predicted = hist_1 * VagLutDecoder[predict][0] + hist_2 * VagLutDecoder[predict][1];
+        hist_2 = hist_1;
+        hist_1 = predicted + q * scales.step[shift];
+    }
+}
+
+size_t EncodeAdpcm1Segmented(std::span<const int16_t> pcmData, int numChannels, Adpcm1Quality quality,
+                             unsigned numThreads, std::span<uint8_t> output, size_t segmentFrames = 0, int seamFrames = 4)
+{
+    const int samplesPerChunk = 28;
+    if (numChannels <= 0)
+        return 0;
+
+    const size_t totalSamples = pcmData.size() / numChannels;
+    const size_t numFrames = totalSamples / samplesPerChunk;
+    const size_t size = Adpcm1EncodedSize(totalSamples, numChannels);
+    if (segmentFrames == 0)
+        segmentFrames = std::max<size_t>(512, (numFrames + numThreads - 1) / std::max(numThreads, 1u));
+    if (numThreads <= 1 || numFrames <= segmentFrames)
+        return EncodeAdpcm1(pcmData, numChannels, quality, output);
+    if (output.size() < size)
+        return 0;
+
+    const size_t numSegments = (numFrames + segmentFrames - 1) / segmentFrames;
+
+    auto encode_frame = [&](size_t frame, int ch, double& hist_1, double& hist_2) {
+        const int16_t* src = pcmData.data() + frame * samplesPerChunk * numChannels + ch;
+        const Adpcm1Frame best = Adpcm1SearchFrame(src, numChannels, hist_1, hist_2, quality);
+
+        uint8_t* out = output.data() + (frame * numChannels + ch) * 16;
+        *out++ = uint8_t((best.predict << 4) | (best.shift & 0x0F));
+        *out++ = 0x00;
+        for (int i = 0; i < 14; ++i)
+            *out++ = uint8_t(((best.quantized[i * 2 + 1] & 0x0F) << 4) | (best.quantized[i * 2] & 0x0F));
+
+        hist_1 = best.hist_1;
+        hist_2 = best.hist_2;
+    };
+
+    parallel_for(numSegments, numThreads, [&](size_t segment) {
+        const size_t first = segment * segmentFrames;
+        const size_t last = std::min(numFrames, first + segmentFrames);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            // seed from the source, the decoder should be close to it at this point
+            double hist_1 = 0.0, hist_2 = 0.0;
+            if (first) {
+                const size_t pos = first * samplesPerChunk;
+                hist_1 = pcmData[(pos - 1) * numChannels + ch];
+                hist_2 = pcmData[(pos - 2) * numChannels + ch];
+            }
+            for (size_t frame = first; frame < last; ++frame)
+                encode_frame(frame, ch, hist_1, hist_2);
+        }
+    });
+
+    // fix up the seams with the real history
+    for (int ch = 0; ch < numChannels; ++ch) {
+        double hist_1 = 0.0, hist_2 = 0.0;
+        for (size_t frame = 0; frame < std::min(segmentFrames, numFrames); ++frame)
+            Adpcm1ReplayFrame(&output[(frame * numChannels + ch) * 16], hist_1, hist_2);
+
+        for (size_t segment = 1; segment < numSegments; ++segment) {
+            const size_t first = segment * segmentFrames;
+            const size_t last = std::min(numFrames, first + segmentFrames);
+            const size_t seam_end = std::min(last, first + std::max(seamFrames, 0));
+            size_t frame = first;
+            for (; frame < seam_end; ++frame)
+                encode_frame(frame, ch, hist_1, hist_2);
+            for (; frame < last; ++frame)
+                Adpcm1ReplayFrame(&output[(frame * numChannels + ch) * 16], hist_1, hist_2);
+        }
+    }
+
+    uint8_t* out = output.data() + numFrames * numChannels * 16;
+    for (int ch = 0; ch < numChannels; ++ch) {
+        *out++ = 0x00;      // predict/shift
+        *out++ = 0x03;      // flags
+        out = std::fill_n(out, 14, uint8_t(0x00));
+    }
+    return size;
+}
+
+std::vector<uint8_t> EncodeAdpcm1Segmented(std::span<const int16_t> pcmData, int numChannels, Adpcm1Quality quality,
+                                           unsigned numThreads, size_t segmentFrames = 0, int seamFrames = 4)
+{
+    std::vector<uint8_t> output(Adpcm1EncodedSize(pcmData.size() / std::max(numChannels, 1), numChannels));
+    output.resize(EncodeAdpcm1Segmented(pcmData, numChannels, quality, numThreads, std::span<uint8_t>(output),
+                                        segmentFrames, seamFrames));
+    return output;
+}
+
+// Signal-to-noise ratio in dB of an encoded stream against its source, channels decoded separately
+inline double Adpcm1Snr(std::span<const int16_t> pcmData, int numChannels, std::span<const uint8_t> encoded)
+{
+    if (numChannels <= 0)
+        return 0.0;
+
+    const size_t numFrames = std::min(pcmData.size() / numChannels / 28, encoded.size() / 16 / numChannels);
+    double signal = 0.0, noise = 0.0;
+    for (int ch = 0; ch < numChannels; ++ch) {
+        Adpcm1State state;
+        int16_t decoded[28];
+        for (size_t frame = 0; frame < numFrames; ++frame) {
+            DecodeAdpcm1Frame(&encoded[(frame * numChannels + ch) * 16], decoded, state);
+            for (int i = 0; i < 28; ++i) {
+                const double x = pcmData[(frame * 28 + i) * numChannels + ch];
+                signal += x * x;
+                noise += (x - decoded[i]) * (x - decoded[i]);
+            }
+        }
+    }
+    if (noise == 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(signal / noise);
+}
+
+
+// ------
+// Streaming decoder: pulls samples a frame at a time and keeps the history between calls,
+// so a long track can be played or exported through a small buffer.
+class Adpcm1StreamDecoder {
+public:
+    explicit Adpcm1StreamDecoder(std::span<const uint8_t> vagData) : data(vagData) {}
+
+    // decodes up to out.size() samples, returns how many were written (0 once the track is done)
+    size_t read(std::span<int16_t> out)
+    {
+        size_t written = drain(out);
+        while (written < out.size() && next_frame()) {
+            if (out.size() - written >= 28) {
+                DecodeAdpcm1Frame(&data[pos], out.data() + written, state);
+                written += 28;
+            }
+            else {
+                DecodeAdpcm1Frame(&data[pos], frame, state);
+                frame_pos = 0;
+                written += drain(out.subspan(written));
+            }
+            pos += 16;
+        }
+        return written;
+    }
+
+    bool done() const { return frame_pos == 28 && !next_frame(); }
+
+    // resume points for seeking, only meaningful on a frame boundary
+    size_t position() const { return pos; }
+    const Adpcm1State& history() const { return state; }
+    void seek(size_t byte_pos, const Adpcm1State& history)
+    {
+        pos = std::max<size_t>(byte_pos, 16);
+        state = history;
+        frame_pos = 28;
+    }
+
+private:
+    bool next_frame() const { return pos + 16 <= data.size() && data[pos + 1] != 0x03; }
+
+    size_t drain(std::span<int16_t> out)
+    {
+        const size_t n = std::min<size_t>(out.size(), 28 - frame_pos);
+        std::copy_n(frame + frame_pos, n, out.begin());
+        frame_pos += int(n);
+        return n;
+    }
+
+    std::span<const uint8_t> data;
+    size_t pos = 16;            // skip the 16-byte VAG header
+    Adpcm1State state;
+    int16_t frame[28] = {};     // leftover of a frame that did not fit the caller's buffer
+    int frame_pos = 28;
+};
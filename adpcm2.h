@@ -1,11 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
 
-static const int xindexTable[16] = {
+#include "ima_adpcm.h"
+#include "parallel.h"
+
+static constexpr int xindexTable[16] = {
     -1, -1, -1, -1, 2, 4, 6, 6,
     -1, -1, -1, -1, 2, 4, 6, 6
 };
 
-static const int xstepsizeTable[89] = {
+static constexpr int xstepsizeTable[89] = {
     7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
     19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
     50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
@@ -17,61 +24,85 @@ static const int xstepsizeTable[89] = {
     15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
 };
 
-std::vector<int16_t> DecodeAdpcm2(const std::vector<uint8_t>& adpcm_data, int num_channels)
+inline constexpr ImaAdpcmTables adpcm2Tables = MakeImaAdpcmTables(xstepsizeTable, xindexTable);
+
+// Every 36-byte block (per channel) starts with its own predictor and step index, so blocks
+// decode independently. Per block and channel the output is the header sample followed by
+// 64 decoded nibbles: 65 samples per channel.
+inline size_t Adpcm2DecodedSamples(size_t num_bytes, int num_channels)
 {
-    size_t offset = 0;
-    const size_t blockSize = 36 * num_channels;
-    const size_t numBlocks = adpcm_data.size() / blockSize;
-    std::vector<int16_t> pcm_output;
+    if (num_channels <= 0)
+        return 0;
+    return (num_bytes / (36 * size_t(num_channels))) * 65 * num_channels;
+}
 
-    pcm_output.reserve(numBlocks * 64 * num_channels);
+// Decodes blocks [first, last) interleaved: up to Lanes blocks of one channel advance a sample at a time,
+// one block per lane. The lanes are scalar; the win is Lanes independent dependency chains, not SIMD
+template <int Lanes = 8>
+void DecodeAdpcm2Blocks(const uint8_t* adpcm_data, int16_t* pcm_output, int num_channels, size_t first, size_t last)
+{
+    const size_t blockSize = 36 * size_t(num_channels);
+    const size_t outSize = 65 * size_t(num_channels);
 
-    for (size_t block = 0; block < numBlocks; ++block) {
-        struct ChannelState {
-            int predictor;
-            int index;
-        } state[2];
+    for (size_t block = first; block < last; block += Lanes) {
+        const int lanes = int(std::min<size_t>(Lanes, last - block));
 
         for (int ch = 0; ch < num_channels; ++ch) {
-            state[ch].predictor = static_cast<int16_t>(adpcm_data[offset] | (adpcm_data[offset + 1] << 8));
-            state[ch].index = std::clamp(static_cast<int>(adpcm_data[offset + 2]), 0, 88);
-            offset += 4; //reserved
-            pcm_output.push_back(state[ch].predictor);
-        }
-
-        for (int sample = 1; sample < 64; sample += 2) {
-            for (int ch = 0; ch < num_channels; ++ch) {
-                uint8_t byte = adpcm_data[offset++];
-
-                for (int shift = 0; shift <= 4; shift += 4) {
-                    int nibble = (byte >> shift) & 0x0F;
-
-                    int step = xstepsizeTable[state[ch].index];
-                    int diff = step >> 3;
-                    if (nibble & 4) diff += step;
-                    if (nibble & 2) diff += step >> 1;
-                    if (nibble & 1) diff += step >> 2;
-
-                    if (nibble & 8)
-                        state[ch].predictor -= diff;
-                    else
-                        state[ch].predictor += diff;
+            const uint8_t* in[Lanes];
+            int16_t* out[Lanes];
+            int predictor[Lanes], index[Lanes];
 
-                    state[ch].predictor = std::clamp(state[ch].predictor, -32768, 32767);
-
-                    state[ch].index += xindexTable[nibble];
-                    state[ch].index = std::clamp(state[ch].index, 0, 88);
+            for (int l = 0; l < lanes; ++l) {
+                const uint8_t* header = adpcm_data + (block + l) * blockSize + 4 * ch;
+                predictor[l] = static_cast<int16_t>(header[0] | (header[1] << 8));
+                index[l] = std::min<int>(header[2], 88);
+                in[l] = adpcm_data + (block + l) * blockSize + 4 * num_channels + ch;
+                out[l] = pcm_output + (block + l) * outSize;
+                out[l][ch] = static_cast<int16_t>(predictor[l]);
+            }
 
-                    pcm_output.push_back(static_cast<int16_t>(state[ch].predictor));
+            for (int row = 0; row < 32; ++row) {
+                for (int nib = 0; nib < 2; ++nib) {
+                    for (int l = 0; l < lanes; ++l) {
+                        const int code = (in[l][row * num_channels] >> (4 * nib)) & 0x0F;
+                        predictor[l] = std::clamp(predictor[l] + adpcm2Tables.diff[index[l]][code], -32768, 32767);
+                        index[l] = adpcm2Tables.next_index[index[l]][code];
+                        out[l][num_channels + row * 2 * num_channels + ch * 2 + nib] = static_cast<int16_t>(predictor[l]);
+                    }
                 }
             }
         }
     }
+}
+
+// Decodes into a caller-provided buffer of Adpcm2DecodedSamples() values, long tracks are split across threads
+inline size_t DecodeAdpcm2(std::span<const uint8_t> adpcm_data, std::span<int16_t> pcm_output, int num_channels, unsigned num_threads = 1)
+{
+    const size_t numSamples = Adpcm2DecodedSamples(adpcm_data.size(), num_channels);
+    if (numSamples == 0 || pcm_output.size() < numSamples)
+        return 0;
+
+    const size_t numBlocks = adpcm_data.size() / (36 * size_t(num_channels));
+    const size_t minBlocksPerTask = 4096;
+    const size_t numTasks = std::min<size_t>(std::max(num_threads, 1u), (numBlocks + minBlocksPerTask - 1) / minBlocksPerTask);
+    const size_t blocksPerTask = (numBlocks + numTasks - 1) / numTasks;
+
+    parallel_for(numTasks, num_threads, [&](size_t task) {
+        const size_t first = task * blocksPerTask;
+        const size_t last = std::min(numBlocks, first + blocksPerTask);
+        DecodeAdpcm2Blocks(adpcm_data.data(), pcm_output.data(), num_channels, first, last);
+    });
+    return numSamples;
+}
 
+std::vector<int16_t> DecodeAdpcm2(const std::vector<uint8_t>& adpcm_data, int num_channels, unsigned num_threads = 1)
+{
+    std::vector<int16_t> pcm_output(Adpcm2DecodedSamples(adpcm_data.size(), num_channels));
+    DecodeAdpcm2(std::span<const uint8_t>(adpcm_data), pcm_output, num_channels, num_threads);
     return pcm_output;
 }
 
-std::vector<uint8_t> EncodeAdpcm2(const std::vector<int16_t>& pcm, int numChannels)
+std::vector<uint8_t> EncodeAdpcm2(std::span<const int16_t> pcm, int numChannels)
 {
     int16_t predictor[2] = { 0 };
     int index[2] = { 0 };
@@ -138,3 +169,198 @@ std::vector<uint8_t> EncodeAdpcm2(const std::vector<int16_t>& pcm, int numChanne
     }
     return encoded;
 }
+
+
+// ------
+// Block-parallel encoder. Blocks restart their predictor from the source, so every block can be
+// encoded on its own, straight into an exactly sized output. The starting step index is stored in
+// the block header, so instead of always starting at 0 it is searched per block and channel.
+
+// Quantizes one sample like EncodeAdpcm2, but the predictor saturates the same way the decoder's does
+inline int Adpcm2QuantizeSample(int sample, int& predictor, int& index)
+{
+    const int step = xstepsizeTable[index];
+    int diff = sample - predictor;
+
+    int nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    int mask = step;
+    if (diff >= mask) { nibble |= 4; diff -= mask; }
+    mask >>= 1;
+    if (diff >= mask) { nibble |= 2; diff -= mask; }
+    mask >>= 1;
+    if (diff >= mask) { nibble |= 1; }
+
+    predictor = std::clamp(predictor + adpcm2Tables.diff[index][nibble], -32768, 32767);
+    index = adpcm2Tables.next_index[index][nibble];
+    return nibble;
+}
+
+// Runs the candidate start indices around an estimate from the opening samples in lock-step
+// and returns the one with the lowest squared error over the block.
+// count is how many of the block's 65 samples exist in the source.
+inline int Adpcm2SearchStepIndex(const int16_t* pcm, size_t stride, size_t count)
+{
+    constexpr int Lanes = 8;
+
+    int peak = 0;
+    for (size_t i = 1; i < std::min<size_t>(count, 8); ++i)
+        peak = std::max(peak, std::abs(pcm[i * stride] - pcm[(i - 1) * stride]));
+
+    int estimate = 0;
+    while (estimate < 88 && xstepsizeTable[estimate] < peak / 2)
+        ++estimate;
+    const int first = std::clamp(estimate - 3, 0, 88 - (Lanes - 1));
+
+    int predictor[Lanes], index[Lanes];
+    int64_t error[Lanes];
+    for (int l = 0; l < Lanes; ++l) {
+        predictor[l] = pcm[0];
+        index[l] = first + l;
+        error[l] = 0;
+    }
+
+    for (size_t i = 1; i < count; ++i) {
+        const int sample = pcm[i * stride];
+        for (int l = 0; l < Lanes; ++l) {
+            Adpcm2QuantizeSample(sample, predictor[l], index[l]);
+            const int64_t e = sample - predictor[l];
+            error[l] += e * e;
+        }
+    }
+    return first + int(std::min_element(error, error + Lanes) - error);
+}
+
+// Encodes block [blockStart, blockStart + 64] of one channel into its 4 header bytes and 32 data bytes
+inline void EncodeAdpcm2Block(std::span<const int16_t> pcm, int numChannels, size_t blockStart, int ch,
+                              bool searchStepIndex, uint8_t* block)
+{
+    const size_t totalSamples = pcm.size() / numChannels;
+    const size_t count = std::min<size_t>(65, totalSamples - blockStart);
+    const int16_t* src = pcm.data() + blockStart * numChannels + ch;
+
+    int predictor = src[0];
+    int index = searchStepIndex ? Adpcm2SearchStepIndex(src, numChannels, count) : 0;
+
+    uint8_t* header = block + 4 * ch;
+    header[0] = predictor & 0xFF;
+    header[1] = (predictor >> 8) & 0xFF;
+    header[2] = static_cast<uint8_t>(index);
+    header[3] = 0;
+
+    uint8_t* data = block + 4 * numChannels + ch;
+    for (size_t i = 1; i < 65; i += 2) {
+        uint8_t packed = 0;
+        for (size_t nib = 0; nib < 2; ++nib) {
+            // past the end of the source the encoder holds the predictor, like EncodeAdpcm2
+            const int sample = (i + nib < count) ? src[(i + nib) * numChannels] : predictor;
+            packed |= Adpcm2QuantizeSample(sample, predictor, index) << (4 * nib);
+        }
+        data[(i / 2) * numChannels] = packed;
+    }
+}
+
+// exact size EncodeAdpcm2() produces: a 36-byte block per channel for every 64 frames started
+inline size_t Adpcm2EncodedSize(size_t frames, int numChannels)
+{
+    if (numChannels <= 0)
+        return 0;
+    return (frames + 63) / 64 * 36 * size_t(numChannels);
+}
+
+// Encodes into a caller buffer of at least Adpcm2EncodedSize() bytes, returns the bytes written
+size_t EncodeAdpcm2(std::span<const int16_t> pcm, int numChannels, std::span<uint8_t> encoded, unsigned numThreads,
+                    bool searchStepIndex = true)
+{
+    if (numChannels <= 0 || pcm.size() < size_t(numChannels))
+        return 0;
+
+    const size_t samplesPerBlock = 64;
+    const size_t blockSize = 36 * size_t(numChannels);
+    const size_t totalSamples = pcm.size() / numChannels;
+    const size_t numBlocks = (totalSamples + samplesPerBlock - 1) / samplesPerBlock;
+    if (encoded.size() < numBlocks * blockSize)
+        return 0;
+
+    const size_t blocksPerTask = 1024;
+    parallel_for((numBlocks + blocksPerTask - 1) / blocksPerTask, numThreads, [&](size_t task) {
+        const size_t last = std::min(numBlocks, (task + 1) * blocksPerTask);
+        for (size_t block = task * blocksPerTask; block < last; ++block)
+            for (int ch = 0; ch < numChannels; ++ch)
+                EncodeAdpcm2Block(pcm, numChannels, block * samplesPerBlock, ch, searchStepIndex, &encoded[block * blockSize]);
+    });
+    return numBlocks * blockSize;
+}
+
+std::vector<uint8_t> EncodeAdpcm2(std::span<const int16_t> pcm, int numChannels, unsigned numThreads, bool searchStepIndex = true)
+{
+    std::vector<uint8_t> encoded(Adpcm2EncodedSize(pcm.size() / std::max(numChannels, 1), numChannels));
+    encoded.resize(EncodeAdpcm2(pcm, numChannels, std::span<uint8_t>(encoded), numThreads, searchStepIndex));
+    return encoded;
+}
+
+
+// ------
+// Streaming decoder: whole blocks go straight into the caller's buffer, a block that does not
+// fit is decoded once into a small buffer and handed out over the following calls.
+class Adpcm2StreamDecoder {
+public:
+    Adpcm2StreamDecoder(std::span<const uint8_t> adpcm_data, int num_channels)
+        : data(adpcm_data), num_channels(std::max(num_channels, 1)),
+          num_blocks(adpcm_data.size() / (36 * size_t(std::max(num_channels, 1)))),
+          block(65 * size_t(std::max(num_channels, 1))), block_pos(block.size()) {}
+
+    // decodes up to out.size() samples, returns how many were written (0 once the track is done)
+    size_t read(std::span<int16_t> out)
+    {
+        size_t written = drain(out);
+        const size_t blockSamples = block.size();
+
+        const size_t whole = std::min(num_blocks - next_block, (out.size() - written) / blockSamples);
+        if (whole) {
+            // DecodeAdpcm2Blocks addresses blocks by index, so shift the base pointers to land at written
+            DecodeAdpcm2Blocks(data.data() + next_block * 36 * num_channels,
+                               out.data() + written, num_channels, 0, whole);
+            next_block += whole;
+            written += whole * blockSamples;
+        }
+
+        if (written < out.size() && next_block < num_blocks) {
+            DecodeAdpcm2Blocks(data.data() + next_block * 36 * num_channels, block.data(), num_channels, 0, 1);
+            ++next_block;
+            block_pos = 0;
+            written += drain(out.subspan(written));
+        }
+        return written;
+    }
+
+    bool done() const { return block_pos == block.size() && next_block == num_blocks; }
+
+    // blocks carry their own state, so any block is a seek point
+    size_t samples_per_block() const { return block.size(); }
+    void seek_block(size_t index)
+    {
+        next_block = std::min(index, num_blocks);
+        block_pos = block.size();
+    }
+
+private:
+    size_t drain(std::span<int16_t> out)
+    {
+        const size_t n = std::min(out.size(), block.size() - block_pos);
+        std::copy_n(block.begin() + block_pos, n, out.begin());
+        block_pos += n;
+        return n;
+    }
+
+    std::span<const uint8_t> data;
+    int num_channels;
+    size_t num_blocks;
+    size_t next_block = 0;
+    std::vector<int16_t> block;     // leftover of a block that did not fit the caller's buffer
+    size_t block_pos;
+};
@@ -0,0 +1,295 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "wbk.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+// ------
+// Cross-bank catalog: which bank holds each entry hash, what the entry is and a fingerprint of its
+// payload, so lookups never open a bank. The file is one image that load() maps and uses in place:
+//   header_t, bank_t[num_banks], entry_t[num_entries] sorted by hash, then the bank path pool.
+// update() only reads banks whose size or modification time changed since the last update.
+
+class BankCatalog {
+public:
+#   pragma pack(push, 1)
+    struct entry_t {
+        uint64_t content_hash;      // PayloadHash() of the payload
+        uint32_t hash;
+        uint32_t bank;              // index into the catalog's banks
+        uint32_t index;             // entry index inside the bank
+        uint32_t num_samples;       // nslWave::num_samples as stored
+        uint32_t payload_offs;
+        uint32_t payload_size;
+        uint16_t sample_rate;
+        uint8_t codec;
+        uint8_t channels;
+    };
+    struct bank_t {
+        int64_t mtime;              // last write time, in the file clock's ticks
+        uint64_t size;
+        uint32_t path_offs;         // absolute path in the pool
+        uint32_t path_size;
+        uint32_t num_entries;
+        uint32_t reserved;
+    };
+#   pragma pack(pop)
+
+    struct update_stats_t {
+        size_t scanned = 0;         // banks read because they are new or changed
+        size_t reused = 0;          // banks taken over unchanged
+        size_t removed = 0;         // banks that were catalogued but are no longer listed
+        std::vector<std::string> errors;
+    };
+
+    bool load(const std::filesystem::path& path);
+    bool save(const std::filesystem::path& path) const;
+
+    // makes the catalog cover exactly these banks
+    void update(std::span<const std::filesystem::path> paths, unsigned threads, update_stats_t& stats);
+
+    // every entry with this hash, across all banks
+    std::span<const entry_t> find(uint32_t hash) const;
+
+    std::span<const entry_t> all_entries() const { return entries; }
+    size_t num_banks() const { return banks.size(); }
+    const bank_t& bank(uint32_t i) const { return banks[i]; }
+    std::string_view bank_path(uint32_t i) const { return std::string_view(pool + banks[i].path_offs, banks[i].path_size); }
+
+    static constexpr char Magic[8] = { 'W', 'B', 'K', 'C', 'A', 'T', '0', '1' };
+
+private:
+#   pragma pack(push, 1)
+    struct header_t {
+        char magic[8];
+        uint32_t num_banks;
+        uint32_t num_entries;
+        uint32_t pool_size;
+        uint32_t reserved;
+    };
+#   pragma pack(pop)
+
+    bool attach(std::span<const uint8_t> bytes);
+
+    std::shared_ptr<const MappedFile> mapping;      // catalog file, when loaded from one
+    std::vector<uint8_t> owned;                     // image built by update()
+    std::span<const uint8_t> image;
+    std::span<const bank_t> banks;
+    std::span<const entry_t> entries;
+    const char* pool = nullptr;
+};
+
+inline bool BankCatalog::attach(std::span<const uint8_t> bytes)
+{
+    header_t header;
+    if (bytes.size() < sizeof(header_t))
+        return false;
+    std::memcpy(&header, bytes.data(), sizeof(header_t));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        return false;
+
+    const size_t banks_offs = sizeof(header_t);
+    const size_t entries_offs = banks_offs + sizeof(bank_t) * size_t(header.num_banks);
+    const size_t pool_offs = entries_offs + sizeof(entry_t) * size_t(header.num_entries);
+    if (bytes.size() < pool_offs + header.pool_size)
+        return false;
+
+    auto* bank_table = reinterpret_cast<const bank_t*>(bytes.data() + banks_offs);
+    auto* entry_table = reinterpret_cast<const entry_t*>(bytes.data() + entries_offs);
+    for (uint32_t b = 0; b < header.num_banks; ++b)
+        if (size_t(bank_table[b].path_offs) + bank_table[b].path_size > header.pool_size)
+            return false;
+    for (uint32_t e = 0; e < header.num_entries; ++e)
+        if (entry_table[e].bank >= header.num_banks)
+            return false;
+
+    image = bytes;
+    banks = { bank_table, header.num_banks };
+    entries = { entry_table, header.num_entries };
+    pool = reinterpret_cast<const char*>(bytes.data() + pool_offs);
+    return true;
+}
+
+inline bool BankCatalog::load(const std::filesystem::path& path)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path) || !attach(file->bytes()))
+        return false;
+    owned.clear();
+    mapping = std::move(file);
+    return true;
+}
+
+inline bool BankCatalog::save(const std::filesystem::path& path) const
+{
+    if (image.empty()) {
+        BankCatalog none;
+        update_stats_t stats;
+        none.update({}, 1, stats);
+        return none.save(path);
+    }
+
+    FILE* out = nullptr;
+#ifdef _WIN32
+    if (_wfopen_s(&out, path.c_str(), L"wb") != 0) out = nullptr;
+#else
+    out = std::fopen(path.c_str(), "wb");
+#endif
+    if (!out)
+        return false;
+    const bool ok = std::fwrite(image.data(), 1, image.size(), out) == image.size();
+    return std::fclose(out) == 0 && ok;
+}
+
+inline std::span<const BankCatalog::entry_t> BankCatalog::find(uint32_t hash) const
+{
+    auto first = std::lower_bound(entries.begin(), entries.end(), hash,
+                                  [](const entry_t& e, uint32_t h) { return e.hash < h; });
+    auto last = std::upper_bound(first, entries.end(), hash,
+                                 [](uint32_t h, const entry_t& e) { return h < e.hash; });
+    return entries.subspan(size_t(first - entries.begin()), size_t(last - first));
+}
+
+inline void BankCatalog::update(std::span<const std::filesystem::path> paths, unsigned threads, update_stats_t& stats)
+{
+    namespace fs = std::filesystem;
+
+    std::unordered_map<std::string_view, uint32_t> previous;
+    for (uint32_t b = 0; b < banks.size(); ++b)
+        previous.emplace(bank_path(b), b);
+
+    // stat every bank and read the new or changed ones, a bank per worker
+    struct scanned_t {
+        std::string path;
+        bank_t info{};
+        int64_t previous = -1;      // same bank in the current catalog, unchanged
+        std::vector<entry_t> entries;
+        std::string error;
+    };
+    std::vector<scanned_t> next(paths.size());
+    parallel_for(paths.size(), threads, [&](size_t b) {
+        auto& s = next[b];
+        std::error_code ec;
+        s.path = fs::absolute(paths[b], ec).lexically_normal().string();
+        s.info.size = fs::file_size(paths[b], ec);
+        if (!ec)
+            s.info.mtime = int64_t(fs::last_write_time(paths[b], ec).time_since_epoch().count());
+        if (ec) {
+            s.error = "Failed to stat " + paths[b].string();
+            return;
+        }
+        const auto it = previous.find(s.path);
+        if (it != previous.end() && banks[it->second].size == s.info.size && banks[it->second].mtime == s.info.mtime) {
+            s.previous = it->second;
+            return;
+        }
+
+        Trace::Scope scope(g_trace, "catalog_bank");
+        WBK wbk;
+        try {
+            if (wbk.read(paths[b], /*DecodeTracks=*/false) != WBK_OK) {
+                s.error = "Failed to parse " + paths[b].string();
+                return;
+            }
+        }
+        catch (const std::exception& e) {
+            s.error = "Failed to read " + paths[b].string() + ": " + e.what();
+            return;
+        }
+        s.entries.reserve(wbk.entries.size());
+        for (int i = 0; i < (int)wbk.entries.size(); ++i) {
+            const auto& w = wbk.entries[i];
+            const auto payload = wbk.payload(i);
+            scope.add(payload.size());
+            entry_t e{};
+            e.content_hash = PayloadHash(payload);
+            e.hash = uint32_t(w.hash);
+            e.index = uint32_t(i);
+            e.num_samples = uint32_t(w.num_samples);
+            e.payload_offs = uint32_t(w.compressed_data_offs);
+            e.payload_size = uint32_t(payload.size());
+            e.sample_rate = uint16_t(w.samples_per_second);
+            e.codec = uint8_t(w.codec);
+            e.channels = uint8_t(WBK::GetNumChannels(w));
+            s.entries.push_back(e);
+        }
+    });
+
+    // renumber the banks that made it, then carry the unchanged banks' entries over
+    std::vector<int64_t> renumbered(banks.size(), -1);
+    std::vector<bank_t> new_banks;
+    std::string new_pool;
+    std::vector<entry_t> new_entries;
+    for (auto& s : next) {
+        if (!s.error.empty()) {
+            stats.errors.push_back(std::move(s.error));
+            continue;
+        }
+        const uint32_t b = uint32_t(new_banks.size());
+        bank_t info = s.info;
+        info.path_offs = uint32_t(new_pool.size());
+        info.path_size = uint32_t(s.path.size());
+        new_pool += s.path;
+        if (s.previous >= 0) {
+            info.num_entries = banks[size_t(s.previous)].num_entries;
+            renumbered[size_t(s.previous)] = b;
+            stats.reused++;
+        }
+        else {
+            info.num_entries = uint32_t(s.entries.size());
+            for (auto e : s.entries) {
+                e.bank = b;
+                new_entries.push_back(e);
+            }
+            stats.scanned++;
+        }
+        new_banks.push_back(info);
+    }
+    std::vector<bool> listed(banks.size(), false);
+    for (const auto& s : next)
+        if (auto it = previous.find(s.path); it != previous.end())
+            listed[it->second] = true;
+    stats.removed = size_t(std::count(listed.begin(), listed.end(), false));
+    for (auto e : entries) {
+        if (renumbered[e.bank] >= 0) {
+            e.bank = uint32_t(renumbered[e.bank]);
+            new_entries.push_back(e);
+        }
+    }
+    std::sort(new_entries.begin(), new_entries.end(), [](const entry_t& a, const entry_t& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.bank != b.bank ? a.bank < b.bank : a.index < b.index;
+    });
+
+    header_t header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.num_banks = uint32_t(new_banks.size());
+    header.num_entries = uint32_t(new_entries.size());
+    header.pool_size = uint32_t(new_pool.size());
+
+    std::vector<uint8_t> built(sizeof(header_t) + sizeof(bank_t) * new_banks.size() + sizeof(entry_t) * new_entries.size() + new_pool.size());
+    uint8_t* out = built.data();
+    auto put = [&](const void* data, size_t size) {
+        if (size) std::memcpy(out, data, size);
+        out += size;
+    };
+    put(&header, sizeof(header_t));
+    put(new_banks.data(), sizeof(bank_t) * new_banks.size());
+    put(new_entries.data(), sizeof(entry_t) * new_entries.size());
+    put(new_pool.data(), new_pool.size());
+
+    mapping.reset();
+    owned.swap(built);
+    attach(owned);
+}
@@ -0,0 +1,299 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "hash_dictionary.h"
+#include "parallel.h"
+
+// ------
+// Brute-force name recovery for the engine hash. Since hash(a + b) = hash(a) * 33^len(b) + hash(b),
+// every piece of a template is hashed once up front and a candidate costs one multiply-add per slot;
+// prefixes shared by many candidates are hashed once per prefix, not once per candidate.
+//
+// A template is literal text with {...} slots, each expanding to a list of alternatives:
+//   {01..99}      numeric range, zero padded to the width of the first bound when it has a leading zero
+//   {a,b,c}       alternatives, which may be empty: "step{,_loop}"
+//   {@words.txt}  one alternative per line of a word list (relative paths are taken from base_dir)
+// e.g. "sfx/{web,wall}_swing_{01..99}{,_lp}"
+
+struct CrackHit {
+    uint32_t hash;
+    std::string name;
+};
+
+class HashTemplate;
+
+// Every name the templates expand to whose hash is in targets, in template and expansion order
+std::vector<CrackHit> CrackHashes(std::span<const HashTemplate> templates, std::span<const uint32_t> targets, unsigned threads);
+
+class HashTemplate {
+public:
+    // returns false and sets error on bad syntax or an unreadable word list
+    bool parse(std::string_view text, const std::filesystem::path& base_dir, std::string& error);
+
+    // number of names the template expands to, saturated at UINT64_MAX
+    uint64_t candidates() const;
+
+    const std::string& source() const { return text; }
+
+private:
+    friend std::vector<CrackHit> CrackHashes(std::span<const HashTemplate> templates, std::span<const uint32_t> targets, unsigned threads);
+
+    // one alternative: where its text sits in the pool, its hash from 0 and 33^length
+    struct part_t {
+        uint32_t offs;
+        uint32_t length;
+        uint32_t hash;
+        uint32_t scale;
+    };
+    struct slot_t {
+        std::vector<part_t> parts;
+    };
+
+    void add_part(slot_t& slot, std::string_view part);
+    std::string_view part_text(const part_t& part) const { return std::string_view(pool).substr(part.offs, part.length); }
+
+    std::string text;
+    std::string pool;
+    std::vector<slot_t> slots;
+};
+
+inline void HashTemplate::add_part(slot_t& slot, std::string_view part)
+{
+    uint32_t scale = 1;
+    for (size_t i = 0; i < part.size(); ++i)
+        scale *= 33u;
+    slot.parts.push_back({ uint32_t(pool.size()), uint32_t(part.size()), HashDictionary::hash(part), scale });
+    pool += part;
+}
+
+inline bool HashTemplate::parse(std::string_view source, const std::filesystem::path& base_dir, std::string& error)
+{
+    text = source;
+    pool.clear();
+    slots.clear();
+
+    std::string literal;
+    auto flush_literal = [&] {
+        if (literal.empty())
+            return;
+        // literals fold into the previous single-part slot, so they cost nothing per candidate
+        if (!slots.empty() && slots.back().parts.size() == 1 && pool.size() == slots.back().parts.back().offs + slots.back().parts.back().length) {
+            part_t& last = slots.back().parts.back();
+            std::string joined(part_text(last));
+            joined += literal;
+            pool.resize(last.offs);
+            slots.back().parts.clear();
+            add_part(slots.back(), joined);
+        }
+        else {
+            slots.emplace_back();
+            add_part(slots.back(), literal);
+        }
+        literal.clear();
+    };
+
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] == '}') {
+            error = "unmatched '}'";
+            return false;
+        }
+        if (source[i] != '{') {
+            literal += source[i];
+            continue;
+        }
+
+        const size_t close = source.find('}', i + 1);
+        if (close == std::string_view::npos) {
+            error = "unmatched '{'";
+            return false;
+        }
+        const std::string_view body = source.substr(i + 1, close - i - 1);
+        i = close;
+        flush_literal();
+        slot_t slot;
+
+        if (!body.empty() && body[0] == '@') {
+            std::filesystem::path path(std::string(body.substr(1)));
+            if (path.is_relative())
+                path = base_dir / path;
+            std::ifstream in(path);
+            if (!in) {
+                error = "cannot read word list " + path.string();
+                return false;
+            }
+            std::string line;
+            while (std::getline(in, line)) {
+                while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+                    line.pop_back();
+                if (!line.empty())
+                    add_part(slot, line);
+            }
+        }
+        else if (const size_t dots = body.find(".."); dots != std::string_view::npos) {
+            const std::string_view lo = body.substr(0, dots), hi = body.substr(dots + 2);
+            uint64_t first = 0, last = 0;
+            auto r1 = std::from_chars(lo.data(), lo.data() + lo.size(), first);
+            auto r2 = std::from_chars(hi.data(), hi.data() + hi.size(), last);
+            if (lo.empty() || hi.empty() || r1.ec != std::errc() || r1.ptr != lo.data() + lo.size() ||
+                r2.ec != std::errc() || r2.ptr != hi.data() + hi.size() || first > last) {
+                error = "bad range {" + std::string(body) + "}";
+                return false;
+            }
+            if (last - first >= 100000000) {
+                error = "range {" + std::string(body) + "} is too large, split it into slots";
+                return false;
+            }
+            const size_t width = lo.size() > 1 && lo[0] == '0' ? lo.size() : 0;
+            char buf[32];
+            for (uint64_t v = first; ; ++v) {
+                auto r = std::to_chars(buf, buf + sizeof(buf), v);
+                std::string number(buf, r.ptr);
+                if (number.size() < width)
+                    number.insert(0, width - number.size(), '0');
+                add_part(slot, number);
+                if (v == last)
+                    break;
+            }
+        }
+        else {
+            for (size_t start = 0; ; ) {
+                const size_t comma = body.find(',', start);
+                add_part(slot, body.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start));
+                if (comma == std::string_view::npos)
+                    break;
+                start = comma + 1;
+            }
+        }
+
+        if (slot.parts.empty()) {
+            error = "empty slot {" + std::string(body) + "}";
+            return false;
+        }
+        slots.push_back(std::move(slot));
+    }
+    flush_literal();
+
+    if (slots.empty()) {
+        error = "empty template";
+        return false;
+    }
+    return true;
+}
+
+inline uint64_t HashTemplate::candidates() const
+{
+    uint64_t total = 1;
+    for (const auto& slot : slots) {
+        if (total > UINT64_MAX / slot.parts.size())
+            return UINT64_MAX;
+        total *= slot.parts.size();
+    }
+    return total;
+}
+
+inline std::vector<CrackHit> CrackHashes(std::span<const HashTemplate> templates, std::span<const uint32_t> targets, unsigned threads)
+{
+    std::vector<CrackHit> hits;
+    if (targets.empty())
+        return hits;
+
+    // sorted targets behind a 2^20-bit filter on the low hash bits, which the last character spreads well
+    std::vector<uint32_t> sorted(targets.begin(), targets.end());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<uint64_t> filter(size_t(1) << 14);
+    for (uint32_t h : sorted)
+        filter[(h & 0xFFFFF) >> 6] |= uint64_t(1) << (h & 63);
+    auto is_target = [&](uint32_t h) {
+        return (filter[(h & 0xFFFFF) >> 6] >> (h & 63) & 1) && std::binary_search(sorted.begin(), sorted.end(), h);
+    };
+
+    threads = std::max(threads, 1u);
+    for (const HashTemplate& tmpl : templates) {
+        const auto& slots = tmpl.slots;
+        const size_t depth = slots.size();
+
+        // the leading slots are split into work items, enough to keep every thread busy, and the rest
+        // is walked depth-first by whoever picks the item up; if that is still too few items (a single
+        // word list, say), the last slot is cut into chunks as well
+        const auto& last = slots[depth - 1].parts;
+        size_t split = 0;
+        uint64_t prefixes = 1;
+        while (split + 1 < depth && prefixes < uint64_t(threads) * 64) {
+            if (prefixes > UINT64_MAX / slots[split].parts.size())
+                break;
+            prefixes *= slots[split++].parts.size();
+        }
+        const uint64_t chunks = std::clamp<uint64_t>(uint64_t(threads) * 64 / prefixes, 1, last.size());
+        const uint64_t items = prefixes * chunks;
+
+        struct found_t { size_t item; CrackHit hit; };
+        std::vector<found_t> found;
+        std::mutex found_lock;
+
+        parallel_for(size_t(items), threads, [&](size_t item) {
+            std::vector<uint32_t> choice(depth, 0);
+            std::vector<uint32_t> state(depth + 1, 0);     // state[k]: hash of the chosen parts before slot k
+
+            const uint64_t chunk = item % chunks;
+            const uint32_t last_begin = uint32_t(last.size() * chunk / chunks);
+            const uint32_t last_end = uint32_t(last.size() * (chunk + 1) / chunks);
+            uint64_t rest = item / chunks;
+            for (size_t k = split; k-- > 0; ) {
+                choice[k] = uint32_t(rest % slots[k].parts.size());
+                rest /= slots[k].parts.size();
+            }
+            for (size_t k = 0; k < split; ++k) {
+                const auto& p = slots[k].parts[choice[k]];
+                state[k + 1] = state[k] * p.scale + p.hash;
+            }
+
+            auto report = [&](uint32_t h) {
+                CrackHit hit{ h, {} };
+                for (size_t k = 0; k < depth; ++k)
+                    hit.name += tmpl.part_text(slots[k].parts[choice[k]]);
+                std::lock_guard guard(found_lock);
+                found.push_back({ item, std::move(hit) });
+            };
+
+            // odometer over slots [split, depth - 1), the last slot is the inner loop
+            size_t k = split;
+            for (;;) {
+                for (; k + 1 < depth; ++k) {
+                    const auto& p = slots[k].parts[choice[k]];
+                    state[k + 1] = state[k] * p.scale + p.hash;
+                }
+                const uint32_t base = state[depth - 1];
+                for (uint32_t i = last_begin; i < last_end; ++i) {
+                    const uint32_t h = base * last[i].scale + last[i].hash;
+                    if (is_target(h)) {
+                        choice[depth - 1] = i;
+                        report(h);
+                    }
+                }
+
+                // advance to the next prefix
+                while (k > split && ++choice[k - 1] == slots[k - 1].parts.size())
+                    choice[--k] = 0;
+                if (k == split)
+                    break;
+                --k;
+            }
+        });
+
+        std::stable_sort(found.begin(), found.end(), [](const found_t& a, const found_t& b) { return a.item < b.item; });
+        for (auto& f : found)
+            hits.push_back(std::move(f.hit));
+    }
+    return hits;
+}
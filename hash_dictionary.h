@@ -0,0 +1,267 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// ------
+// Hash -> name dictionary shared by extraction, replace and anything else that resolves entry hashes.
+//
+// Names live in one image: a header, the hashes in ascending order, count + 1 name offsets and a
+// string pool, so name i is pool[offsets[i], offsets[i + 1]). compile() writes that image to disk
+// and load() maps a compiled file and uses it in place; text dictionaries are parsed into the same
+// image. Lookups are a binary search over the hash array and return views into the pool.
+//
+// Text dictionaries take one entry per line:
+//   - a raw name, hashed with the engine hash (e.g. "sfx/ambience/wind_light")
+//   - "0x12345678<tab or space>name", as in string_hash_dictionary.txt; the listed hash is kept
+//   - comments starting with '#' or '//', and blank lines
+// Raw names must be made of letters, digits and "_./\-:"; anything else (such as the header lines
+// of string_hash_dictionary.txt) is skipped rather than hashed into a junk entry.
+// When names collide on a hash the first one wins.
+
+class HashDictionary {
+public:
+    // engine string hash: ASCII letters lowercased, multiplier 33, other bytes added as signed chars.
+    // The only implementation; string_hash::to_hash forwards here
+    static constexpr uint32_t hash(std::string_view name)
+    {
+        uint32_t res = 0;
+        for (char c : name)
+            res = uint32_t(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : static_cast<signed char>(c)) + 33u * res;
+        return res;
+    }
+
+    // text or compiled, detected by the magic; replaces the current contents
+    bool load(const std::filesystem::path& path);
+    bool load_text(std::string_view text);
+    void assign(std::vector<std::pair<uint32_t, std::string_view>> names);
+
+    // writes the compiled image, which load() maps without parsing
+    bool compile(const std::filesystem::path& path) const;
+    static bool is_compiled(const std::filesystem::path& path);
+
+    // name for hash, empty when unknown
+    std::string_view find(uint32_t hash) const;
+    bool contains(uint32_t hash) const { return std::binary_search(hashes.begin(), hashes.end(), hash); }
+
+    size_t size() const { return hashes.size(); }
+    bool empty() const { return hashes.empty(); }
+    std::string_view name(size_t i) const;
+    uint32_t hash_at(size_t i) const { return hashes[i]; }
+
+    static constexpr char Magic[8] = { 'W', 'B', 'K', 'D', 'I', 'C', 'T', '1' };
+
+private:
+#   pragma pack(push, 1)
+    struct header_t {
+        char magic[8];
+        uint32_t count;
+        uint32_t pool_size;
+    };
+#   pragma pack(pop)
+
+    bool attach(std::span<const uint8_t> image);
+
+    std::shared_ptr<const MappedFile> mapping;      // compiled file, when loaded from one
+    std::vector<uint8_t> owned;                     // image built from a text dictionary
+    std::span<const uint8_t> image;
+    std::span<const uint32_t> hashes;
+    std::span<const uint32_t> offsets;
+    const char* pool = nullptr;
+};
+
+inline std::string_view HashDictionary::name(size_t i) const
+{
+    const uint32_t first = offsets[i], last = offsets[i + 1];
+    return last > first ? std::string_view(pool + first, last - first) : std::string_view();
+}
+
+inline std::string_view HashDictionary::find(uint32_t hash) const
+{
+    auto it = std::lower_bound(hashes.begin(), hashes.end(), hash);
+    if (it == hashes.end() || *it != hash)
+        return {};
+    return name(size_t(it - hashes.begin()));
+}
+
+// checks the image and points the hash, offset and pool views into it. Everything find() and name()
+// index is validated here once, so a truncated or corrupt file is rejected instead of read out of bounds
+inline bool HashDictionary::attach(std::span<const uint8_t> bytes)
+{
+    header_t header;
+    if (bytes.size() < sizeof(header_t))
+        return false;
+    std::memcpy(&header, bytes.data(), sizeof(header_t));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        return false;
+
+    const size_t count = header.count;
+    const size_t tables = sizeof(uint32_t) * (count * 2 + 1);
+    const size_t body = bytes.size() - sizeof(header_t);
+    if (body < tables || body - tables < header.pool_size)
+        return false;
+    auto* table = reinterpret_cast<const uint32_t*>(bytes.data() + sizeof(header_t));
+    const uint32_t* name_offsets = table + count;
+
+    // hashes strictly ascending for the binary search, name ranges ascending and ending at the pool size
+    for (size_t i = 1; i < count; ++i)
+        if (table[i] <= table[i - 1])
+            return false;
+    for (size_t i = 0; i < count; ++i)
+        if (name_offsets[i] > name_offsets[i + 1])
+            return false;
+    if (name_offsets[count] != header.pool_size)
+        return false;
+
+    image = bytes;
+    hashes = { table, count };
+    offsets = { name_offsets, count + 1 };
+    pool = reinterpret_cast<const char*>(name_offsets + count + 1);
+    return true;
+}
+
+inline void HashDictionary::assign(std::vector<std::pair<uint32_t, std::string_view>> names)
+{
+    // sorted by hash, first name per hash kept
+    std::stable_sort(names.begin(), names.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    names.erase(std::unique(names.begin(), names.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), names.end());
+
+    size_t pool_size = 0;
+    for (const auto& [hash, name] : names)
+        pool_size += name.size();
+
+    std::vector<uint8_t> built(sizeof(header_t) + sizeof(uint32_t) * (names.size() * 2 + 1) + pool_size);
+    header_t header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.count = uint32_t(names.size());
+    header.pool_size = uint32_t(pool_size);
+    std::memcpy(built.data(), &header, sizeof(header_t));
+
+    auto* table = reinterpret_cast<uint32_t*>(built.data() + sizeof(header_t));
+    char* out = reinterpret_cast<char*>(table + names.size() * 2 + 1);
+    uint32_t offs = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        table[i] = names[i].first;
+        table[names.size() + i] = offs;
+        std::memcpy(out + offs, names[i].second.data(), names[i].second.size());
+        offs += uint32_t(names[i].second.size());
+    }
+    table[names.size() * 2] = offs;
+
+    mapping.reset();
+    owned.swap(built);
+    attach(owned);
+}
+
+inline bool HashDictionary::load_text(std::string_view text)
+{
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; };
+    auto trim = [&](std::string_view s) {
+        while (!s.empty() && is_space(s.front())) s.remove_prefix(1);
+        while (!s.empty() && is_space(s.back())) s.remove_suffix(1);
+        return s;
+    };
+    auto is_name = [](std::string_view s) {
+        bool alnum = false;
+        for (char c : s) {
+            if (std::isalnum(static_cast<unsigned char>(c)))
+                alnum = true;
+            else if (std::string_view("_./\\-:").find(c) == std::string_view::npos)
+                return false;
+        }
+        return alnum;
+    };
+
+    // the views point into text, which only has to outlive assign()
+    std::vector<std::pair<uint32_t, std::string_view>> names;
+    while (!text.empty()) {
+        const size_t eol = text.find('\n');
+        std::string_view line = trim(text.substr(0, eol));
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+        if (line.empty() || line[0] == '#' || line.substr(0, 2) == "//")
+            continue;
+
+        if (line.size() > 2 && line[0] == '0' && (line[1] == 'x' || line[1] == 'X')) {
+            const size_t sep = line.find_first_of(" \t");
+            if (sep == std::string_view::npos)
+                continue;   // only a hash, nothing to resolve it to
+            const std::string_view name = trim(line.substr(sep + 1));
+            if (name.empty())
+                continue;
+            uint32_t hash = 0;
+            const char* last = line.data() + sep;
+            auto res = std::from_chars(line.data() + 2, last, hash, 16);
+            names.emplace_back(res.ec == std::errc() && res.ptr == last ? hash : HashDictionary::hash(name), name);
+        }
+        else if (is_name(line)) {
+            names.emplace_back(HashDictionary::hash(line), line);
+        }
+    }
+    assign(std::move(names));
+    return true;
+}
+
+inline bool HashDictionary::load(const std::filesystem::path& path)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) {
+        // an empty file is an empty dictionary
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec) && std::filesystem::file_size(path, ec) == 0 && !ec) {
+            assign({});
+            return true;
+        }
+        return false;
+    }
+
+    // a compiled image that fails validation is rejected and the file is read as text instead
+    const auto bytes = file->bytes();
+    if (bytes.size() >= sizeof(Magic) && std::memcmp(bytes.data(), Magic, sizeof(Magic)) == 0 && attach(bytes)) {
+        owned.clear();
+        mapping = std::move(file);
+        return true;
+    }
+    return load_text(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+}
+
+inline bool HashDictionary::is_compiled(const std::filesystem::path& path)
+{
+    char magic[sizeof(Magic)] = {};
+    std::ifstream in(path, std::ios::binary);
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+inline bool HashDictionary::compile(const std::filesystem::path& path) const
+{
+    if (image.empty()) {
+        HashDictionary none;
+        none.assign({});
+        return none.compile(path);
+    }
+
+    FILE* out = nullptr;
+#ifdef _WIN32
+    if (_wfopen_s(&out, path.c_str(), L"wb") != 0) out = nullptr;
+#else
+    out = std::fopen(path.c_str(), "wb");
+#endif
+    if (!out)
+        return false;
+
+    const bool ok = std::fwrite(image.data(), 1, image.size(), out) == image.size();
+    return std::fclose(out) == 0 && ok;
+}
@@ -1,11 +1,15 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
 
 struct ImaAdpcmState {
     int valprev = 0;
     int index = 0;
 };
-const int stepsizeTable[89] = {
+constexpr int stepsizeTable[89] = {
     7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
     34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
     157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544,
@@ -14,15 +18,32 @@ const int stepsizeTable[89] = {
     6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818,
     18499, 20350, 22385, 24623, 27086, 29794, 32767
 };
-const int indexTable[16] = {
+constexpr int indexTable[16] = {
     -1, -1, -1, -1, 2, 4, 6, 8,
     -1, -1, -1, -1, 2, 4, 6, 8
 };
 
+// exact size EncodeImaAdpcm() produces: a nibble per mono sample, a byte per stereo frame
+inline size_t ImaAdpcmEncodedSize(size_t frames, int numChannels)
+{
+    if (numChannels == 1) return (frames + 1) / 2;
+    if (numChannels == 2) return frames;
+    return 0;
+}
+
+// samples DecodeImaAdpcm() writes for a payload, two per byte whatever the layout
+inline size_t ImaAdpcmDecodedSamples(size_t bytes)
+{
+    return bytes * 2;
+}
+
 // taken from ALSA
-static std::vector<uint8_t> EncodeImaAdpcm(const std::vector<int16_t>& pcmSamples, int numChannels)
+// Encodes into a caller buffer of at least ImaAdpcmEncodedSize() bytes, returns the bytes written
+static size_t EncodeImaAdpcm(std::span<const int16_t> pcmSamples, int numChannels, std::span<uint8_t> outBuff)
 {
-    std::vector<uint8_t> outBuff;
+    size_t written = 0;
+    if (outBuff.size() < ImaAdpcmEncodedSize(pcmSamples.size() / std::max(numChannels, 1), numChannels))
+        return 0;
 
     if (numChannels == 1)
     {
@@ -58,13 +79,13 @@ static std::vector<uint8_t> EncodeImaAdpcm(const std::vector<int16_t>& pcmSample
             }
             else {
                 nibbleBuffer |= ((sign | adjust_idx) << 4);
-                outBuff.push_back(nibbleBuffer);
+                outBuff[written++] = nibbleBuffer;
                 hasHighNibble = false;
             }
         }
 
         if (hasHighNibble)
-            outBuff.push_back(nibbleBuffer);
+            outBuff[written++] = nibbleBuffer;
     }
     else if (numChannels == 2)
     {
@@ -100,60 +121,200 @@ static std::vector<uint8_t> EncodeImaAdpcm(const std::vector<int16_t>& pcmSample
             uint8_t leftNib = encodeSample(left, stateL);
             uint8_t rightNib = encodeSample(right, stateR);
 
-            outBuff.push_back((rightNib << 4) | (leftNib & 0x0F));
+            outBuff[written++] = (rightNib << 4) | (leftNib & 0x0F);
         }
     }
     else {
         printf("Unsupported number of channels\n");
     }
 
+    return written;
+}
+
+static std::vector<uint8_t> EncodeImaAdpcm(std::span<const int16_t> pcmSamples, int numChannels)
+{
+    std::vector<uint8_t> outBuff(ImaAdpcmEncodedSize(pcmSamples.size() / std::max(numChannels, 1), numChannels));
+    outBuff.resize(EncodeImaAdpcm(pcmSamples, numChannels, std::span<uint8_t>(outBuff)));
     return outBuff;
 }
 
 static std::vector<uint8_t> EncodeImaAdpcm(const std::vector<uint8_t>& wavBytes, int numChannels)
 {
-    std::vector<int16_t> pcmSamples;
-    for (size_t i = 0; i + 1 < wavBytes.size(); i += 2) {
-        pcmSamples.push_back((int16_t)(wavBytes[i] | (wavBytes[i + 1] << 8)));
+    std::vector<int16_t> pcmSamples(wavBytes.size() / 2);
+    std::memcpy(pcmSamples.data(), wavBytes.data(), pcmSamples.size() * sizeof(int16_t));
+    return EncodeImaAdpcm(std::span<const int16_t>(pcmSamples), numChannels);
+}
+
+// ------
+// Table-driven decoding: for every step index and nibble, the signed difference and the next index.
+struct ImaAdpcmTables {
+    int32_t diff[89][16];
+    uint8_t next_index[89][16];
+};
+
+constexpr ImaAdpcmTables MakeImaAdpcmTables(const int (&steps)[89], const int (&indices)[16])
+{
+    ImaAdpcmTables t{};
+    for (int index = 0; index < 89; ++index) {
+        const int step = steps[index];
+        for (int code = 0; code < 16; ++code) {
+            int diff = step >> 3;
+            if (code & 1) diff += step >> 2;
+            if (code & 2) diff += step >> 1;
+            if (code & 4) diff += step;
+            t.diff[index][code] = (code & 8) ? -diff : diff;
+            t.next_index[index][code] = static_cast<uint8_t>(std::clamp(index + indices[code], 0, 88));
+        }
+    }
+    return t;
+}
+
+inline constexpr ImaAdpcmTables imaAdpcmTables = MakeImaAdpcmTables(stepsizeTable, indexTable);
+
+inline int16_t DecodeImaAdpcmNibble(ImaAdpcmState& state, int code)
+{
+    state.valprev = std::clamp(state.valprev + imaAdpcmTables.diff[state.index][code], -32768, 32767);
+    state.index = imaAdpcmTables.next_index[state.index][code];
+    return static_cast<int16_t>(state.valprev);
+}
+
+// Nibbles alternate between channels, low nibble first: mono decodes both nibbles into the same
+// channel, stereo puts the low nibble in the left and the high nibble in the right channel.
+// out must hold 2 * samples.size() values, returns the number written.
+template <int Channels>
+size_t DecodeImaAdpcmT(std::span<const uint8_t> samples, std::span<int16_t> out, ImaAdpcmState (&states)[Channels])
+{
+    static_assert(Channels == 1 || Channels == 2, "specialized for mono and stereo only");
+
+    const size_t count = std::min(samples.size(), out.size() / 2);
+    ImaAdpcmState first = states[0];
+    ImaAdpcmState second = states[Channels - 1];
+    int16_t* dst = out.data();
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t byte = samples[i];
+        if constexpr (Channels == 1) {
+            dst[2 * i + 0] = DecodeImaAdpcmNibble(first, byte & 0x0F);
+            dst[2 * i + 1] = DecodeImaAdpcmNibble(first, byte >> 4);
+        }
+        else {
+            // the two channels are independent, so both updates can overlap
+            dst[2 * i + 0] = DecodeImaAdpcmNibble(first, byte & 0x0F);
+            dst[2 * i + 1] = DecodeImaAdpcmNibble(second, byte >> 4);
+        }
+    }
+
+    states[0] = first;
+    if constexpr (Channels == 2)
+        states[1] = second;
+    return count * 2;
+}
+
+// Decodes into a caller-supplied buffer of at least 2 * samples.size() values
+inline size_t DecodeImaAdpcm(std::span<const uint8_t> samples, std::span<int16_t> out, int num_channels = 1)
+{
+    if (num_channels == 1) {
+        ImaAdpcmState states[1];
+        return DecodeImaAdpcmT<1>(samples, out, states);
     }
-    return EncodeImaAdpcm(pcmSamples, numChannels);
+    if (num_channels == 2) {
+        ImaAdpcmState states[2];
+        return DecodeImaAdpcmT<2>(samples, out, states);
+    }
+
+    // any other layout: nibble n belongs to channel n % num_channels
+    std::vector<ImaAdpcmState> states(std::max(num_channels, 1));
+    const size_t count = std::min(samples.size() * 2, out.size());
+    for (size_t sample_idx = 0; sample_idx < count; ++sample_idx) {
+        const uint8_t byte = samples[sample_idx / 2];
+        const int code = (sample_idx & 1) ? (byte >> 4) : (byte & 0x0F);
+        out[sample_idx] = DecodeImaAdpcmNibble(states[sample_idx % states.size()], code);
+    }
+    return count;
 }
 
 std::vector<int16_t> DecodeImaAdpcm(const std::vector<uint8_t>& samples, int num_channels = 1)
-{    
-    std::vector<ImaAdpcmState> states(num_channels);
+{
+    std::vector<int16_t> outBuff(samples.size() * 2);
+    DecodeImaAdpcm(std::span<const uint8_t>(samples), outBuff, num_channels);
+    return outBuff;
+}
 
-    size_t sample_count = (samples.size() * 2);
-    std::vector<int16_t> outBuff;
-    outBuff.resize(sample_count);
 
-    int sample_idx = 0;
+// ------
+// Streaming decoder: the per-channel predictor and step index carry over between read() calls
+class ImaAdpcmStreamDecoder {
+public:
+    ImaAdpcmStreamDecoder(std::span<const uint8_t> samples, int num_channels = 1)
+        : data(samples), states(std::max(num_channels, 1)) {}
 
-    for (uint8_t byte : samples) {
-        for (int shift = 0; shift <= 4; shift += 4) {
-            uint8_t code = (byte >> shift) & 0x0F;
-            int channel = sample_idx % num_channels;
+    // decodes up to out.size() samples, returns how many were written (0 once the track is done)
+    size_t read(std::span<int16_t> out)
+    {
+        size_t written = 0;
+        if (has_pending && !out.empty()) {
+            out[written++] = pending;
+            has_pending = false;
+        }
 
-            auto& state = states[channel];
+        // whole bytes straight into the caller's buffer
+        const size_t bytes = std::min(data.size() - pos, (out.size() - written) / 2);
+        written += decode(data.subspan(pos, bytes), out.subspan(written, bytes * 2));
+        pos += bytes;
 
-            int step = stepsizeTable[state.index];
-            int diff = step >> 3;
-            if (code & 1) diff += step >> 2;
-            if (code & 2) diff += step >> 1;
-            if (code & 4) diff += step;
+        // one slot left: decode the next byte and keep its high nibble for the next call
+        if (written < out.size() && pos < data.size()) {
+            int16_t pair[2];
+            decode(data.subspan(pos, 1), pair);
+            ++pos;
+            out[written++] = pair[0];
+            pending = pair[1];
+            has_pending = true;
+        }
+        return written;
+    }
 
-            if (code & 8)
-                state.valprev -= diff;
-            else
-                state.valprev += diff;
+    bool done() const { return !has_pending && pos >= data.size(); }
 
-            state.valprev = std::clamp(state.valprev, -32768, 32767);
-            state.index += indexTable[code];
-            state.index = std::clamp(state.index, 0, 88);
+    // resume points for seeking, only meaningful on a byte boundary
+    size_t position() const { return pos; }
+    const std::vector<ImaAdpcmState>& channel_states() const { return states; }
+    void seek(size_t byte_pos, std::span<const ImaAdpcmState> channel_states)
+    {
+        pos = std::min(byte_pos, data.size());
+        std::copy_n(channel_states.begin(), std::min(channel_states.size(), states.size()), states.begin());
+        has_pending = false;
+    }
 
-            outBuff[sample_idx++] = static_cast<int16_t>(state.valprev);
+private:
+    size_t decode(std::span<const uint8_t> bytes, std::span<int16_t> out)
+    {
+        if (states.size() == 1) {
+            ImaAdpcmState s[1] = { states[0] };
+            size_t n = DecodeImaAdpcmT<1>(bytes, out, s);
+            states[0] = s[0];
+            return n;
         }
+        if (states.size() == 2) {
+            ImaAdpcmState s[2] = { states[0], states[1] };
+            size_t n = DecodeImaAdpcmT<2>(bytes, out, s);
+            states[0] = s[0];
+            states[1] = s[1];
+            return n;
+        }
+
+        // nibble n of the stream belongs to channel n % num_channels
+        size_t nibble = (pos * 2) % states.size();
+        for (size_t i = 0; i < bytes.size() * 2; ++i, nibble = (nibble + 1) % states.size()) {
+            const int code = (i & 1) ? (bytes[i / 2] >> 4) : (bytes[i / 2] & 0x0F);
+            out[i] = DecodeImaAdpcmNibble(states[nibble], code);
+        }
+        return bytes.size() * 2;
     }
 
-    return outBuff;
-}
\ No newline at end of file
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+    std::vector<ImaAdpcmState> states;
+    int16_t pending = 0;
+    bool has_pending = false;
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+// Read-only mapping of a whole file. Pages are only faulted in when touched.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& path);
+    void close();
+
+    bool is_open() const { return base != nullptr; }
+    const uint8_t* data() const { return base; }
+    size_t size() const { return length; }
+    std::span<const uint8_t> bytes() const { return { base, length }; }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+
+inline bool MappedFile::open(const std::filesystem::path& path)
+{
+    close();
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        return false;
+    }
+
+    base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+inline void MappedFile::close()
+{
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    base = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+inline bool MappedFile::open(const std::filesystem::path& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference
+    if (p == MAP_FAILED)
+        return false;
+
+    base = static_cast<const uint8_t*>(p);
+    length = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+inline void MappedFile::close()
+{
+    if (base) munmap(const_cast<uint8_t*>(base), length);
+    base = nullptr;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned default_thread_count()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// Runs fn(i) for every i in [0, count) on up to num_threads threads.
+// Indices are handed out in order; the first exception thrown by a worker is rethrown here.
+template <typename Fn>
+void parallel_for(size_t count, unsigned num_threads, Fn&& fn)
+{
+    num_threads = (unsigned)std::min<size_t>(std::max(num_threads, 1u), count);
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> failed = false;
+    std::exception_ptr error;
+    std::mutex error_lock;
+
+    auto worker = [&] {
+        for (size_t i = next++; i < count && !failed; i = next++) {
+            try {
+                fn(i);
+            }
+            catch (...) {
+                std::lock_guard guard(error_lock);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (unsigned t = 1; t < num_threads; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
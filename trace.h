@@ -0,0 +1,186 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#   include <psapi.h>
+#   ifdef _MSC_VER
+#       pragma comment(lib, "psapi.lib")
+#   endif
+#else
+#   include <sys/resource.h>
+#endif
+
+// Peak resident set size of this process in bytes, 0 where unknown
+inline size_t PeakRssBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#   ifdef __APPLE__
+    return size_t(usage.ru_maxrss);
+#   else
+    return size_t(usage.ru_maxrss) * 1024;
+#   endif
+#endif
+}
+
+// Phase timing and counters, off until enable(). A disabled Scope costs one relaxed load.
+// Phases are keyed "name" or "name/detail" (e.g. "encode/ADPCM_1"); with events kept, every
+// scope also becomes a complete ("X") event for the Chrome trace viewer.
+class Trace {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct phase_t {
+        uint64_t count = 0;
+        double seconds = 0.0;
+        uint64_t bytes = 0;
+        uint64_t samples = 0;
+    };
+
+    void enable(bool keep_events)
+    {
+        std::lock_guard guard(lock);
+        events_on = keep_events;
+        start = clock::now();
+        on.store(true, std::memory_order_relaxed);
+    }
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+    void record(const char* name, const char* detail, clock::time_point begin, clock::time_point end,
+                uint64_t bytes, uint64_t samples, int track)
+    {
+        std::string key = name;
+        if (detail) (key += '/') += detail;
+
+        std::lock_guard guard(lock);
+        auto& phase = phases[key];
+        phase.count++;
+        phase.seconds += std::chrono::duration<double>(end - begin).count();
+        phase.bytes += bytes;
+        phase.samples += samples;
+
+        if (events_on) {
+            auto tid = threads.try_emplace(std::this_thread::get_id(), int(threads.size()) + 1).first->second;
+            events.push_back({ std::move(key), name,
+                std::chrono::duration<double, std::micro>(begin - start).count(),
+                std::chrono::duration<double, std::micro>(end - begin).count(),
+                tid, track, bytes, samples });
+        }
+    }
+
+    // RAII timer for one phase; bytes/samples can be added while it runs
+    class Scope {
+    public:
+        explicit Scope(Trace& trace, const char* name, const char* detail = nullptr, int track = -1)
+            : trace(trace.enabled() ? &trace : nullptr), name(name), detail(detail), track(track)
+        {
+            if (this->trace)
+                begin = clock::now();
+        }
+        ~Scope()
+        {
+            if (trace)
+                trace->record(name, detail, begin, clock::now(), bytes, samples, track);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        void add(uint64_t num_bytes, uint64_t num_samples = 0) { bytes += num_bytes; samples += num_samples; }
+
+    private:
+        Trace* trace;
+        const char* name;
+        const char* detail;
+        int track;
+        clock::time_point begin;
+        uint64_t bytes = 0;
+        uint64_t samples = 0;
+    };
+
+    void print_stats(FILE* out) const
+    {
+        std::lock_guard guard(lock);
+        std::fprintf(out, "%-28s %8s %12s %12s %10s %14s\n", "phase", "count", "total ms", "MB", "MB/s", "samples");
+        for (const auto& [key, phase] : phases) {
+            const double mb = phase.bytes / 1e6;
+            std::fprintf(out, "%-28s %8llu %12.3f %12.3f %10.2f %14llu\n", key.c_str(),
+                         (unsigned long long)phase.count, phase.seconds * 1e3, mb,
+                         phase.seconds > 0 ? mb / phase.seconds : 0.0, (unsigned long long)phase.samples);
+        }
+        std::fprintf(out, "peak RSS: %.1f MB\n", PeakRssBytes() / 1e6);
+    }
+
+    bool write_chrome_trace(const std::filesystem::path& path) const
+    {
+        FILE* out = nullptr;
+#ifdef _WIN32
+        if (_wfopen_s(&out, path.c_str(), L"wb") != 0) out = nullptr;
+#else
+        out = std::fopen(path.c_str(), "wb");
+#endif
+        if (!out)
+            return false;
+
+        std::lock_guard guard(lock);
+        std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (size_t i = 0; i < events.size(); ++i) {
+            const auto& e = events[i];
+            std::fprintf(out, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                              "\"args\":{\"bytes\":%llu,\"samples\":%llu",
+                         e.key.c_str(), e.cat, e.ts, e.dur, e.tid, (unsigned long long)e.bytes, (unsigned long long)e.samples);
+            if (e.track >= 0)
+                std::fprintf(out, ",\"track\":%d", e.track);
+            std::fprintf(out, "}},\n");
+        }
+        // counters at the end, so the viewer shows the peak next to the timeline
+        std::fprintf(out, "{\"name\":\"peak_rss_mb\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"MB\":%.1f}}\n]}\n",
+                     std::chrono::duration<double, std::micro>(clock::now() - start).count(), PeakRssBytes() / 1e6);
+        const bool ok = !std::ferror(out);
+        std::fclose(out);
+        return ok;
+    }
+
+private:
+    struct event_t {
+        std::string key;
+        const char* cat;
+        double ts, dur;         // microseconds since enable()
+        int tid;
+        int track;
+        uint64_t bytes, samples;
+    };
+
+    std::atomic<bool> on = false;
+    bool events_on = false;
+    clock::time_point start = clock::now();
+    mutable std::mutex lock;
+    std::map<std::string, phase_t> phases;
+    std::map<std::thread::id, int> threads;
+    std::vector<event_t> events;
+};
+
+// process-wide instance used by the WBK/WAV code and the tool
+inline Trace g_trace;
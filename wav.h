@@ -7,6 +7,10 @@
 #include <filesystem>
 #include <stdexcept>
 #include <algorithm>
+#include <memory>
+#include <span>
+#include "mapped_file.h"
+#include "trace.h"
 #include "ima_adpcm.h"
 
 struct WAV {
@@ -27,76 +31,184 @@ struct WAV {
         uint32_t subchunk2Size;
     } header;
     #pragma pack(pop)
-    std::vector<uint8_t> samples;
+    // the data chunk stays in the mapped file; only a misaligned chunk is copied into owned
+    std::shared_ptr<const MappedFile> mapping;
+    size_t data_offset = 0;
+    size_t data_size = 0;
+    std::vector<int16_t> owned;
 
+    std::span<const int16_t> pcm() const {
+        if (!owned.empty() || !mapping)
+            return owned;
+        return { reinterpret_cast<const int16_t*>(mapping->data() + data_offset), data_size / sizeof(int16_t) };
+    }
+    size_t pcm_bytes() const { return pcm().size_bytes(); }
 
     bool readWAV(const std::filesystem::path& filename) {
-        std::ifstream f(filename, std::ios::binary);
-        if (!f.good()) return false;
+        Trace::Scope scope(g_trace, "read_wav");
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(filename)) return false;
 
-        samples.clear();
+        mapping.reset();
+        owned.clear();
+        data_offset = data_size = 0;
 
-        char riff[4], wave[4];
-        uint32_t riffSize = 0;
-        if (!f.read(riff, 4) || !f.read(reinterpret_cast<char*>(&riffSize), 4) || !f.read(wave, 4))
-            return false;
-        if (std::string(riff, 4) != "RIFF" || std::string(wave, 4) != "WAVE")
+        const uint8_t* bytes = file->data();
+        const size_t size = file->size();
+        if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0)
             return false;
 
+        auto read_u16 = [&](size_t at) { uint16_t v; std::memcpy(&v, bytes + at, 2); return v; };
+        auto read_u32 = [&](size_t at) { uint32_t v; std::memcpy(&v, bytes + at, 4); return v; };
+
         bool gotFmt = false, gotData = false;
-        while (f && !(gotFmt && gotData)) {
-            char id[4];
-            uint32_t sz = 0;
-            if (!f.read(id, 4) || !f.read(reinterpret_cast<char*>(&sz), 4)) break;
-
-            if (std::string(id, 4) == "fmt ") {
-                if (sz < 16) return false;
-                f.read(reinterpret_cast<char*>(&header.audioFormat), 2);
-                f.read(reinterpret_cast<char*>(&header.numChannels), 2);
-                f.read(reinterpret_cast<char*>(&header.sampleRate), 4);
-                f.read(reinterpret_cast<char*>(&header.byteRate), 4);
-                f.read(reinterpret_cast<char*>(&header.blockAlign), 2);
-                f.read(reinterpret_cast<char*>(&header.bitsPerSample), 2);
-                if (sz > 16) f.seekg(sz - 16, std::ios::cur); // skip extras
+        size_t pos = 12;
+        while (pos + 8 <= size && !(gotFmt && gotData)) {
+            const uint8_t* id = bytes + pos;
+            const uint32_t sz = read_u32(pos + 4);
+            const size_t body = pos + 8;
+
+            if (std::memcmp(id, "fmt ", 4) == 0) {
+                if (sz < 16 || size - body < 16) return false;
+                header.audioFormat = read_u16(body + 0);
+                header.numChannels = read_u16(body + 2);
+                header.sampleRate = read_u32(body + 4);
+                header.byteRate = read_u32(body + 8);
+                header.blockAlign = read_u16(body + 12);
+                header.bitsPerSample = read_u16(body + 14);
                 header.subchunk1Size = sz;
                 if (header.audioFormat != 1) return false;
                 gotFmt = true;
             }
-            else if (std::string(id, 4) == "data") {
+            else if (std::memcmp(id, "data", 4) == 0) {
+                if (size - body < sz) return false;
                 header.subchunk2Size = sz;
-                samples.resize(sz);
-                if (!f.read(reinterpret_cast<char*>(samples.data()), sz)) return false;
+                data_offset = body;
+                data_size = sz;
                 gotData = true;
             }
-            else
-                f.seekg(sz + (sz & 1u), std::ios::cur);
+            pos = body + sz + (sz & 1u);
         }
 
-        if ((!gotFmt || !gotData)  || samples.size() % 2) return false;
+        if ((!gotFmt || !gotData) || data_size % 2) return false;
 
         header.blockAlign = static_cast<uint16_t>((header.bitsPerSample / 8) * header.numChannels);
         header.byteRate = header.sampleRate * header.blockAlign;
 
+        // odd-sized chunks before data leave it misaligned for int16_t, copy in that case
+        if ((reinterpret_cast<uintptr_t>(bytes + data_offset) % alignof(int16_t)) != 0) {
+            owned.resize(data_size / sizeof(int16_t));
+            std::memcpy(owned.data(), bytes + data_offset, data_size);
+        }
+        else
+            mapping = std::move(file);
+
+        scope.add(data_size, data_size / sizeof(int16_t));
         return true;
     }
-    static bool writeWAV(const std::string& filename, std::vector<int16_t>& samples, uint32_t sampleRate, int nchannels = 1) {
-        WAVHeader header;
+    static bool writeWAV(const std::string& filename, const std::vector<int16_t>& samples, uint32_t sampleRate, int nchannels = 1);
+};
+
+// Streaming WAV output: the header goes out first with placeholder sizes, PCM is appended in blocks
+// as it is decoded and the RIFF/data sizes are patched on close()
+class WavWriter {
+public:
+    static constexpr size_t default_buffer_bytes = size_t(1) << 20;
+
+    WavWriter() = default;
+    WavWriter(const std::filesystem::path& filename, uint32_t sampleRate, int nchannels = 1, size_t bufferBytes = default_buffer_bytes) {
+        open(filename, sampleRate, nchannels, bufferBytes);
+    }
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+    ~WavWriter() { close(); }
+
+    bool open(const std::filesystem::path& filename, uint32_t sampleRate, int nchannels = 1, size_t bufferBytes = default_buffer_bytes) {
+        close();
+        header = {};
         header.sampleRate = sampleRate;
-        header.numChannels = nchannels;
+        header.numChannels = static_cast<uint16_t>(nchannels);
         header.bitsPerSample = 16;
         header.blockAlign = (header.bitsPerSample * header.numChannels) / 8;
         header.byteRate = header.sampleRate * header.blockAlign;
-        header.subchunk2Size = (int)samples.size() * sizeof(int16_t);
-        header.chunkSize = 36 + header.subchunk2Size;
+        header.subchunk2Size = 0;
+        header.chunkSize = 36;
+        data_bytes = 0;
+        failed = false;
 
-        std::ofstream outFile(filename, std::ios::binary);
-        if (!outFile)
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
             return false;
-        else {
-            outFile.write(reinterpret_cast<const char*>(&header), sizeof(WAVHeader));
-            outFile.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(int16_t));
-            outFile.close();
-            return true;
+        // our own buffer, so the stream does not copy every block a second time
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        buffer.clear();
+        buffer.reserve(std::max<size_t>(bufferBytes, sizeof(WAV::WAVHeader)));
+        append(&header, sizeof header);
+        return true;
+    }
+
+    bool is_open() const { return file.is_open(); }
+    uint64_t bytes_written() const { return data_bytes; }
+
+    bool write(std::span<const int16_t> samples) {
+        if (!file.is_open() || failed)
+            return false;
+        Trace::Scope scope(g_trace, "write_wav");
+        scope.add(samples.size_bytes(), samples.size());
+        data_bytes += samples.size_bytes();
+        append(samples.data(), samples.size_bytes());
+        return !failed;
+    }
+
+    // flushes, patches the sizes in the header and closes; false if any write failed
+    bool close() {
+        if (!file.is_open())
+            return false;
+        flush();
+        if (data_bytes > UINT32_MAX - 36)
+            failed = true;
+        header.subchunk2Size = static_cast<uint32_t>(data_bytes);
+        header.chunkSize = 36 + header.subchunk2Size;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof header);
+        file.close();
+        const bool ok = !failed && !file.fail();
+        failed = true;
+        return ok;
+    }
+
+private:
+    void append(const void* src, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(src);
+        if (buffer.size() + size > buffer.capacity())
+            flush();
+        // blocks at least as large as the buffer go straight to the file
+        if (size >= buffer.capacity()) {
+            file.write(reinterpret_cast<const char*>(bytes), size);
+            failed |= file.fail();
+            return;
         }
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    void flush() {
+        if (!buffer.empty())
+            file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        failed |= file.fail();
+        buffer.clear();
     }
+
+    std::ofstream file;
+    std::vector<uint8_t> buffer;
+    WAV::WAVHeader header;
+    uint64_t data_bytes = 0;
+    bool failed = false;
 };
+
+bool WAV::writeWAV(const std::string& filename, const std::vector<int16_t>& samples, uint32_t sampleRate, int nchannels) {
+    WavWriter writer;
+    if (!writer.open(filename, sampleRate, nchannels, sizeof(WAVHeader)))
+        return false;
+    writer.write(samples);
+    return writer.close();
+}
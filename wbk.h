@@ -8,78 +8,55 @@
 #include <stdexcept>
 #include <algorithm>
 #include <bitset>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <variant>
 
+#include "mapped_file.h"
+#include "trace.h"
 #include "wav.h"
 #include "adpcm1.h"
 #include "adpcm2.h"
+#include "hash_dictionary.h"
 
 #include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <charconv>
+#include <sstream>
+#include <climits>
 
 // ------
 struct string_hash {
     int hash;
     string_hash(int h) : hash(h) {}
     static constexpr inline std::uint32_t to_hash(const char* str) {
-        std::uint32_t res = 0;
-
-        for (int c = *str; c != '\0'; ++str, c = *str) {
-            int ch_lower = [](auto c) -> int {
-                if (isalpha(c))
-                    return tolower(c);
-                return c;
-                }(c);
-            res = ch_lower + 33 * res;
-        }
-
-        return res;
+        return HashDictionary::hash(str);
     }
 };
 
-static inline void skip_newlines(std::string& s) {
-    while (!s.empty() && (s.back() == '\r' || s.back() == '\n')) s.pop_back();
-}
-
-static const std::unordered_map<uint32_t, std::string>& get_string_hash_dictionary() {
-    static std::unordered_map<uint32_t, std::string> dict;
-    static std::once_flag loaded_once;
-    std::call_once(loaded_once, [] {
-        std::ifstream in("string_hash_dictionary.txt");
-        if (!in) return;
-        std::string line;
-        std::getline(in, line); std::getline(in, line); std::getline(in, line); // skip first 3 lines
-        while (std::getline(in, line)) {
-            skip_newlines(line);
-            if (line.empty()) continue;
-
-            const auto tab_pos = line.find('\t');
-            if (tab_pos == std::string::npos) continue;
-
-            const std::string_view prefix(line.c_str(), tab_pos);
-            if (prefix.size() < 3 || prefix[0] != '0' || (prefix[1] != 'x' && prefix[1] != 'X')) continue;
-
-            uint32_t key = 0;
-            const char* first = line.c_str() + 2;
-            const char* last = line.c_str() + tab_pos; // up to tab
-            auto res = std::from_chars(first, last, key, 16);
-            if (res.ec != std::errc() || res.ptr != last) continue;
-
-            std::string value = line.substr(tab_pos + 1);
-            skip_newlines(value);
-            dict.emplace(key, std::move(value));
-        }
-        });
-    return dict;
-}
-
-std::string lookup_string_by_hash(uint32_t hash) {
-    const auto& dict = get_string_hash_dictionary();
-    if (auto it = dict.find(hash); it != dict.end())
-        return it->second;
-    return {};
-}
 // ------
 
+class TrackDecoder;
+
+// Decoder state at a point inside a track, so decoding can resume there instead of at sample 0
+struct TrackSeekPoint {
+    uint64_t sample = 0;        // decoded samples before this point
+    uint64_t byte = 0;          // payload offset the decoder resumes at
+    int32_t state[4] = {};      // ADPCM_1: hist_1, hist_2; IMA: valprev, index for up to two channels
+};
+
+// Encoder settings passed through WBK::encode and ReplacePlan
+struct EncodeOptions {
+    Adpcm1Quality adpcm1_quality = Adpcm1Quality::Exhaustive;
+    unsigned threads = 1;           // > 1 encodes long ADPCM_1 tracks in segments and ADPCM_2 blocks in parallel
+    int seam_frames = 4;            // frames re-encoded at each segment seam
+    bool adpcm2_index_search = true;    // search each ADPCM_2 block's starting step index instead of using 0
+};
+
 class WBK {
 public:
     enum Codec : uint8_t {
@@ -134,17 +111,84 @@ public:
         int field_14;
         int field_18;
         int compressed_data_offs;
-        unsigned __int16 samples_per_second;
-        __int16 field_22;
+        uint16_t samples_per_second;
+        int16_t field_22;
         int unk;
     };
 #   pragma pack(pop)
 
+    // How replace() places new payloads:
+    //   Compact     - payloads from the first replaced entry on are repacked back to back
+    //   KeepOffsets - a payload that fits its current 0x8000-aligned slot is written over it, others
+    //                 move to the end of the bank; nothing else moves, so write_in_place() stays small
+    // With ReplacePlan::dedupe, byte-identical payloads share one copy: Compact repacks the whole bank
+    // that way, KeepOffsets only points replacements at an equal payload that is already in the bank.
+    enum class Layout { Compact, KeepOffsets };
+
+    // Staged set of replacements, laid out in a single pass by WBK::replace(const ReplacePlan&)
+    class ReplacePlan {
+    public:
+        explicit ReplacePlan(const WBK& wbk, const EncodeOptions& options = {}) : wbk(wbk), options(options) {}
+
+        int add(int replacement_index, const WAV& wav, Codec codec = Keep);
+        int add(string_hash hash, const WAV& wav, Codec codec = Keep);
+
+        // stages a payload that was already encoded with target_codec(), e.g. on a worker thread
+        int add(int replacement_index, const WAV& wav, Codec codec, std::vector<uint8_t> encoded);
+        Codec target_codec(int replacement_index, Codec codec) const;
+
+        size_t size() const { return staged.size(); }
+        bool empty() const { return staged.empty(); }
+        void clear() { staged.clear(); }
+
+        Layout layout = Layout::Compact;
+        bool dedupe = false;
+
+    private:
+        friend class WBK;
+        struct staged_t {
+            Codec codec;
+            int num_channels;
+            unsigned int sample_rate;
+            size_t pcm_bytes;
+            std::vector<uint8_t> encoded;
+        };
+
+        const WBK& wbk;
+        EncodeOptions options;
+        std::map<int, staged_t> staged;     // ordered by entry index
+    };
+
+    // what a dedupe pass shared: entries pointed at another entry's payload, and the aligned bytes that saved
+    struct dedupe_stats_t {
+        int shared_entries = 0;
+        size_t bytes_saved = 0;
+    };
+
+    // One entry per codec the bank can hold, sizes are exact and all buffers belong to the caller.
+    // Channels are passed as decoded, i.e. after the ADPCM_2 mono quirk (see GetDecodeChannels()).
+    struct codec_t {
+        Codec codec;
+        const char* name;
+        size_t (*encoded_size)(size_t frames, int channels);
+        size_t (*decoded_samples)(std::span<const uint8_t> payload, int channels);
+        size_t (*encode)(std::span<const int16_t> pcm, int channels, std::span<uint8_t> out, const EncodeOptions& options);
+        size_t (*decode)(std::span<const uint8_t> payload, int channels, std::span<int16_t> out, unsigned threads);
+    };
+
     std::vector <nslWave> entries;
-    std::vector<std::vector<int16_t>> tracks;
+    std::vector<std::shared_ptr<const std::vector<int16_t>>> tracks;    // filled by parse(..., DecodeTracks = true)
     std::vector<metadata_t> metadata;
 
     char bank_group[16] = { '\0' };
+    unsigned decode_threads = 1;    // threads a single decode_track()/track() may use (block-parallel codecs)
+
+    WBK() = default;
+    // a copy shares a mapped file or owns a copy of the bank bytes, and starts with an empty track cache
+    WBK(const WBK& other) { *this = other; }
+    WBK(WBK&&) = default;
+    WBK& operator=(const WBK& other);
+    WBK& operator=(WBK&&) = default;
 
     static int GetNumChannels(const nslWave& wave);
     static void SetNumChannels(nslWave& wave, int num_channels);
@@ -153,20 +197,95 @@ public:
     static int GetDuration(const nslWave& wave);
     static double GetDurationMs(const nslWave& wave);
     static int GetBytesPerSample(Codec codec);
-
-    std::vector<uint8_t> encode(const WAV& wav, Codec codec = Keep);
-
-    std::vector<int16_t> decode(std::vector<uint8_t> samples, const nslWave& entry);
+    static const codec_t* GetCodec(Codec codec);
+    static int GetDecodeChannels(const nslWave& wave);
+    static size_t GetEncodedSize(Codec codec, size_t frames, int channels);
+    static size_t GetDecodedSamples(const nslWave& wave, std::span<const uint8_t> payload);
+    size_t decoded_samples(int index) const;
+
+    static std::vector<uint8_t> encode(const WAV& wav, Codec codec = Keep, const EncodeOptions& options = {});
+    static size_t encode(std::span<const int16_t> pcm, int channels, Codec codec, std::span<uint8_t> out, const EncodeOptions& options = {});
+
+    static std::vector<int16_t> decode(std::span<const uint8_t> payload, const nslWave& entry, unsigned threads = 1);
+    static size_t decode(std::span<const uint8_t> payload, const nslWave& entry, std::span<int16_t> out, unsigned threads = 1);
+    std::vector<int16_t> decode_track(int index) const;
+
+    // on-demand decoding, decoded tracks stay in an LRU cache bounded by set_track_cache_budget()
+    using track_ptr = std::shared_ptr<const std::vector<int16_t>>;
+    track_ptr track(int index);
+    track_ptr track(string_hash hash);
+
+    // streaming decode of one entry through a caller-sized buffer, see TrackDecoder
+    TrackDecoder open_track(int index) const;
+
+    // optional seek index: decoder checkpoints every interval samples for ADPCM_1 and IMA tracks
+    // (ADPCM_2 and PCM seek by arithmetic), so decode_range() costs time proportional to the range
+    void build_seek_index(unsigned interval = 4096);
+    int save_seek_index(std::filesystem::path path) const;
+    int load_seek_index(std::filesystem::path path);
+    size_t decode_range(int index, size_t first_sample, std::span<int16_t> out) const;
+    void set_track_cache_budget(size_t bytes);
 
     int parse(std::istream& stream, const bool DecodeTracks = true);
     void read(const std::vector<uint8_t>& data, const bool DecodeTracks = true);
     int read(std::filesystem::path path, const bool DecodeTracks = true);
     int write(std::filesystem::path path);
-    int replace(int replacement_index, const WAV& wav, Codec codec = Keep);
-    int replace(string_hash hash, const WAV& wav, Codec codec = Keep);
+    // patches only the bytes replace() changed into the file the bank was read from
+    int write_in_place(std::filesystem::path path);
+    int replace(int replacement_index, const WAV& wav, Codec codec = Keep, const EncodeOptions& options = {});
+    int replace(string_hash hash, const WAV& wav, Codec codec = Keep, const EncodeOptions& options = {});
+    int replace(const ReplacePlan& plan, dedupe_stats_t* stats = nullptr);
+    // points entries with byte-identical payloads at a single copy and repacks the bank
+    int dedupe(dedupe_stats_t* stats = nullptr);
+
+    // zero-copy views into the bank (the file mapping after read(path), raw_data otherwise)
+    std::span<const uint8_t> bytes() const { return bank; }
+    const header_t& header_view() const { return *reinterpret_cast<const header_t*>(bank.data()); }
+    std::span<const nslWave> entry_table() const;
+    std::span<const uint8_t> payload(int index) const;
 
 private:
-    std::vector<uint8_t> raw_data;
+    struct track_cache_t {
+        size_t budget = size_t(64) << 20;   // bytes of decoded PCM
+        size_t used = 0;
+        std::list<int> lru;                 // most recently used first
+        std::unordered_map<int, std::pair<track_ptr, std::list<int>::iterator>> items;
+        std::mutex lock;
+
+        // copies and moves keep the budget and start empty, the mutex is never shared
+        track_cache_t() = default;
+        track_cache_t(const track_cache_t& other) : budget(other.budget) {}
+        track_cache_t& operator=(const track_cache_t& other)
+        {
+            if (this != &other) {
+                clear();
+                budget = other.budget;
+            }
+            return *this;
+        }
+
+        void evict(int index);
+        void trim();
+        void clear();
+    };
+
+    int parse_bank(const bool DecodeTracks);
+    int replace_in_slots(const ReplacePlan& plan, dedupe_stats_t* stats);
+    std::vector<size_t> payload_offsets() const;
+    size_t slot_end(std::span<const size_t> offsets, size_t offs) const;
+    void apply_staged(nslWave& entry, const ReplacePlan::staged_t& item);
+    void mark_dirty(size_t begin, size_t end) { if (end > begin) dirty.emplace_back(begin, end); }
+
+    std::vector<uint8_t> raw_data;                  // owned bank, used after edits or when reading from memory
+    std::shared_ptr<const MappedFile> mapping;      // backing file when opened with read(path)
+    std::span<const uint8_t> bank;
+    track_cache_t cache;
+    std::vector<std::vector<TrackSeekPoint>> seek_index;
+    unsigned seek_interval = 0;
+    size_t base_size = 0;                                   // size of the bank as it was read
+    uint64_t base_fingerprint = 0;                          // of its header and entry table
+    std::filesystem::file_time_type base_mtime{};           // of the file it was read from, if any
+    std::vector<std::pair<size_t, size_t>> dirty;           // [begin, end) ranges changed since then
 };
 
 
@@ -176,7 +295,150 @@ enum {
     WBK_FILE_TOO_LARGE,
     WBK_WRITE_ERROR,
     WBK_INVALID_REPLACE_INDEX,
-    WBK_HASH_NOT_FOUND
+    WBK_HASH_NOT_FOUND,
+    WBK_STALE_SEEK_INDEX
+};
+
+
+// Plain 16-bit PCM, handed out as-is
+class PcmStreamDecoder {
+public:
+    explicit PcmStreamDecoder(std::span<const uint8_t> data) : data(data) {}
+
+    size_t read(std::span<int16_t> out)
+    {
+        const size_t n = std::min(out.size(), (data.size() - pos) / sizeof(int16_t));
+        std::memcpy(out.data(), data.data() + pos, n * sizeof(int16_t));
+        pos += n * sizeof(int16_t);
+        return n;
+    }
+
+    bool done() const { return data.size() - pos < sizeof(int16_t); }
+
+    void seek(size_t byte_pos) { pos = std::min(byte_pos, data.size()); }
+
+private:
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+};
+
+// Stateful decoder for one bank entry. Callers pull interleaved samples into their own buffer
+// (N frames = N * channels() samples); concatenated, the reads match WBK::decode_track().
+// The payload has to outlive the decoder.
+class TrackDecoder {
+public:
+    TrackDecoder(const WBK::nslWave& entry, std::span<const uint8_t> payload)
+        : sample_rate_(entry.samples_per_second), channels_(WBK::GetDecodeChannels(entry)),
+          codec_name(WBK::GetCodec(entry.codec) ? WBK::GetCodec(entry.codec)->name : "unknown"),
+          decoder(make_decoder(entry, payload)) {}
+
+    size_t read(std::span<int16_t> out)
+    {
+        Trace::Scope scope(g_trace, "decode", codec_name);
+        const size_t n = std::visit([&](auto& d) -> size_t {
+            if constexpr (std::is_same_v<std::decay_t<decltype(d)>, std::monostate>) return 0;
+            else return d.read(out);
+        }, decoder);
+        position += n;
+        scope.add(n * sizeof(int16_t), n);
+        return n;
+    }
+
+    bool done() const
+    {
+        return std::visit([](const auto& d) -> bool {
+            if constexpr (std::is_same_v<std::decay_t<decltype(d)>, std::monostate>) return true;
+            else return d.done();
+        }, decoder);
+    }
+
+    int channels() const { return channels_; }
+    unsigned sample_rate() const { return sample_rate_; }
+    size_t tell() const { return position; }
+
+    // decoder state right here; taken between read() calls that end on a frame/byte boundary
+    TrackSeekPoint checkpoint() const
+    {
+        TrackSeekPoint point;
+        point.sample = position;
+        if (auto* d = std::get_if<Adpcm1StreamDecoder>(&decoder)) {
+            point.byte = d->position();
+            point.state[0] = d->history().hist_1;
+            point.state[1] = d->history().hist_2;
+        }
+        else if (auto* d = std::get_if<ImaAdpcmStreamDecoder>(&decoder)) {
+            point.byte = d->position();
+            const auto& states = d->channel_states();
+            for (size_t ch = 0; ch < std::min<size_t>(states.size(), 2); ++ch) {
+                point.state[ch * 2 + 0] = states[ch].valprev;
+                point.state[ch * 2 + 1] = states[ch].index;
+            }
+        }
+        return point;
+    }
+
+    // moves to sample, resuming from the last checkpoint at or before it when an index is given
+    void seek(size_t sample, std::span<const TrackSeekPoint> points = {})
+    {
+        const TrackSeekPoint* from = nullptr;
+        auto it = std::upper_bound(points.begin(), points.end(), sample,
+            [](size_t s, const TrackSeekPoint& p) { return s < p.sample; });
+        if (it != points.begin())
+            from = &*(it - 1);
+
+        if (auto* d = std::get_if<Adpcm1StreamDecoder>(&decoder)) {
+            Adpcm1State history;
+            if (from) history = { from->state[0], from->state[1] };
+            d->seek(from ? from->byte : 16, history);
+            position = from ? from->sample : 0;
+        }
+        else if (auto* d = std::get_if<ImaAdpcmStreamDecoder>(&decoder)) {
+            // checkpoints only hold two channels; more than that always starts over
+            std::vector<ImaAdpcmState> states(d->channel_states().size());
+            if (from && states.size() > 2)
+                from = nullptr;
+            for (size_t ch = 0; from && ch < states.size(); ++ch)
+                states[ch] = { from->state[ch * 2 + 0], from->state[ch * 2 + 1] };
+            d->seek(from ? from->byte : 0, states);
+            position = from ? from->sample : 0;
+        }
+        else if (auto* d = std::get_if<Adpcm2StreamDecoder>(&decoder)) {
+            d->seek_block(sample / d->samples_per_block());
+            position = (sample / d->samples_per_block()) * d->samples_per_block();
+        }
+        else if (auto* d = std::get_if<PcmStreamDecoder>(&decoder)) {
+            d->seek(sample * sizeof(int16_t));
+            position = sample;
+        }
+
+        // decode and drop whatever lies between the resume point and the target
+        int16_t scratch[1024];
+        while (position < sample) {
+            const size_t n = read(std::span<int16_t>(scratch, std::min<size_t>(std::size(scratch), sample - position)));
+            if (!n) break;
+        }
+    }
+
+private:
+    using decoder_t = std::variant<std::monostate, PcmStreamDecoder, Adpcm1StreamDecoder, Adpcm2StreamDecoder, ImaAdpcmStreamDecoder>;
+
+    static decoder_t make_decoder(const WBK::nslWave& entry, std::span<const uint8_t> payload)
+    {
+        switch (entry.codec) {
+            case WBK::PCM:
+            case WBK::PCM2:      return PcmStreamDecoder(payload);
+            case WBK::ADPCM_1:   return Adpcm1StreamDecoder(payload);
+            case WBK::ADPCM_2:   return Adpcm2StreamDecoder(payload, 1);    // always decoded as mono, like decode_track()
+            case WBK::IMA_ADPCM: return ImaAdpcmStreamDecoder(payload, WBK::GetNumChannels(entry));
+            default:             return std::monostate{};
+        }
+    }
+
+    unsigned sample_rate_;
+    int channels_;
+    const char* codec_name;
+    decoder_t decoder;
+    size_t position = 0;
 };
 
 
@@ -192,58 +454,55 @@ inline int WBK::GetNumChannels(const nslWave& wave) {
     return num_channels;
 }
 
-class membuf : public std::streambuf {
-public:
-    membuf(const char* base, size_t size) {
-        begin_ = const_cast<char*>(base);
-        end_ = begin_ + size;
-        setg(begin_, begin_, end_);
-    }
-protected:
-    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
-        std::ios_base::openmode which) override {
-        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
-        char* newpos = nullptr;
-        switch (dir) {
-            case std::ios_base::beg: newpos = begin_ + off; break;
-            case std::ios_base::cur: newpos = gptr() + off; break;
-            case std::ios_base::end: newpos = end_ + off;   break;
-            default: return pos_type(off_type(-1));
-        }
-        if (newpos < begin_ || newpos > end_) return pos_type(off_type(-1));
-        setg(begin_, newpos, end_);
-        return pos_type(newpos - begin_);
-    }
-    pos_type seekpos(pos_type sp, std::ios_base::openmode which) override {
-        return seekoff(off_type(sp), std::ios_base::beg, which);
-    }
-private:
-    char* begin_{ nullptr };
-    char* end_{ nullptr };
-};
+void WBK::read(const std::vector<uint8_t>& data, const bool DecodeTracks)
+{
+    if (data.data() != raw_data.data())
+        raw_data.assign(data.begin(), data.end());
 
+    mapping.reset();
+    bank = raw_data;
+    parse_bank(DecodeTracks);
+}
 
-void WBK::read(const std::vector<uint8_t>& data, const bool DecodeTracks)
+int WBK::read(std::filesystem::path path, const bool DecodeTracks)
 {
-    if (data.data() == raw_data.data() && !data.empty()) {
-        std::vector<uint8_t> tmp(data);
-        membuf sbuf(reinterpret_cast<const char*>(tmp.data()), tmp.size());
-        std::istream stream(&sbuf);
-        parse(stream, DecodeTracks);
-        return;
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) {
+        // an empty file has nothing to map but is still a (malformed) bank, which parse_bank rejects
+        std::error_code ec;
+        if (std::filesystem::file_size(path, ec) != 0 || ec)
+            throw std::runtime_error("Failed to open file");
+        file.reset();
     }
 
-    membuf sbuf(reinterpret_cast<const char*>(data.data()), data.size());
-    std::istream stream(&sbuf);
-    parse(stream, DecodeTracks);
+    raw_data.clear();
+    raw_data.shrink_to_fit();
+    mapping = std::move(file);
+    bank = mapping ? mapping->bytes() : std::span<const uint8_t>();
+    const int res = parse_bank(DecodeTracks);
+    std::error_code ec;
+    base_mtime = std::filesystem::last_write_time(path, ec);
+    return res;
 }
 
-int WBK::read(std::filesystem::path path, const bool DecodeTracks)
+inline std::span<const WBK::nslWave> WBK::entry_table() const
+{
+    const size_t table_end = sizeof(header_t) + sizeof(nslWave) * entries.size();
+    if (table_end > bank.size())
+        return {};
+    return { reinterpret_cast<const nslWave*>(bank.data() + sizeof(header_t)), entries.size() };
+}
+
+inline std::span<const uint8_t> WBK::payload(int index) const
 {
-    std::ifstream stream(path, std::ios::binary);
-    if (!stream.good()) throw std::runtime_error("Failed to open file");
-    return parse(stream, DecodeTracks);
+    if (index < 0 || index >= (int)entries.size())
+        return {};
+    const size_t offs = static_cast<size_t>(entries[index].compressed_data_offs);
+    if (offs >= bank.size())
+        return {};
+    return bank.subspan(offs, std::min<size_t>(entries[index].num_bytes, bank.size() - offs));
 }
+
 inline void WBK::SetNumChannels(nslWave& wave, int num_channels) {
     unsigned char channel_mask = 0xFF, new_channel_bits = 0;
     for (int i = 0; i < num_channels; ++i)
@@ -261,6 +520,89 @@ inline int WBK::GetBytesPerSample(Codec codec) {
     }
 }
 
+inline const WBK::codec_t* WBK::GetCodec(Codec codec)
+{
+    static const codec_t codecs[] = {
+        { PCM, "PCM",
+            [](size_t frames, int channels) { return frames * channels * sizeof(int16_t); },
+            [](std::span<const uint8_t> payload, int) { return (payload.size() / 4) * 2; },
+            [](std::span<const int16_t> pcm, int, std::span<uint8_t> out, const EncodeOptions&) -> size_t {
+                if (out.size() < pcm.size_bytes()) return 0;
+                std::memcpy(out.data(), pcm.data(), pcm.size_bytes());
+                return pcm.size_bytes();
+            },
+            [](std::span<const uint8_t> payload, int, std::span<int16_t> out, unsigned) {
+                const size_t count = std::min((payload.size() / 4) * 2, out.size());
+                std::memcpy(out.data(), payload.data(), count * sizeof(int16_t));
+                return count;
+            } },
+        { ADPCM_1, "ADPCM_1",
+            Adpcm1EncodedSize,
+            [](std::span<const uint8_t> payload, int) { return Adpcm1DecodedSamples(payload); },
+            [](std::span<const int16_t> pcm, int channels, std::span<uint8_t> out, const EncodeOptions& options) {
+                return EncodeAdpcm1Segmented(pcm, channels, options.adpcm1_quality, options.threads, out, 0, options.seam_frames);
+            },
+            [](std::span<const uint8_t> payload, int, std::span<int16_t> out, unsigned) {
+                Adpcm1State state;
+                return DecodeAdpcm1Fixed(payload, out, state);
+            } },
+        { ADPCM_2, "ADPCM_2",
+            Adpcm2EncodedSize,
+            [](std::span<const uint8_t> payload, int channels) { return Adpcm2DecodedSamples(payload.size(), channels); },
+            [](std::span<const int16_t> pcm, int channels, std::span<uint8_t> out, const EncodeOptions& options) {
+                return EncodeAdpcm2(pcm, channels, out, options.threads, options.adpcm2_index_search);
+            },
+            [](std::span<const uint8_t> payload, int channels, std::span<int16_t> out, unsigned threads) {
+                return DecodeAdpcm2(payload, out, channels, threads);
+            } },
+        { IMA_ADPCM, "IMA_ADPCM",
+            ImaAdpcmEncodedSize,
+            [](std::span<const uint8_t> payload, int) { return ImaAdpcmDecodedSamples(payload.size()); },
+            [](std::span<const int16_t> pcm, int channels, std::span<uint8_t> out, const EncodeOptions&) {
+                return EncodeImaAdpcm(pcm, channels, out);
+            },
+            [](std::span<const uint8_t> payload, int channels, std::span<int16_t> out, unsigned) {
+                return DecodeImaAdpcm(payload, out, channels);
+            } },
+    };
+
+    if (codec == PCM2)
+        codec = PCM;
+    for (const auto& c : codecs)
+        if (c.codec == codec)
+            return &c;
+    return nullptr;
+}
+
+// ADPCM_2 entries are decoded as a single channel whatever the flags say
+inline int WBK::GetDecodeChannels(const nslWave& wave)
+{
+    return wave.codec == ADPCM_2 ? 1 : GetNumChannels(wave);
+}
+
+inline size_t WBK::GetEncodedSize(Codec codec, size_t frames, int channels)
+{
+    const codec_t* c = GetCodec(codec);
+    return c ? c->encoded_size(frames, channels) : 0;
+}
+
+// exact number of samples decode() writes for this payload
+inline size_t WBK::GetDecodedSamples(const nslWave& wave, std::span<const uint8_t> payload)
+{
+    const codec_t* c = GetCodec(wave.codec);
+    return c ? c->decoded_samples(payload, GetDecodeChannels(wave)) : 0;
+}
+
+inline size_t WBK::decoded_samples(int index) const
+{
+    if (index < 0 || index >= (int)entries.size())
+        return 0;
+    const nslWave& entry = entries[index];
+    if (entry.codec == PCM || entry.codec == PCM2)      // decode_track() reads these from 0x1000
+        return (entry.num_bytes / 4) * 2;
+    return GetDecodedSamples(entry, payload(index));
+}
+
 inline int WBK::GetDuration(const nslWave& wave)
 {
     const int sr = wave.samples_per_second ? wave.samples_per_second : 1;
@@ -284,8 +626,8 @@ inline double WBK::GetDurationMs(const nslWave& wave)
 
 int WBK::GetNumSamples(const nslWave& wave)
 {
-    unsigned int tmp_flag = (unsigned __int8)((((wave.flags & 0x55) + ((wave.flags >> 1) & 0x55)) & 0x33) +
-        (((unsigned __int8)((wave.flags & 0x55) + ((wave.flags >> 1) & 0x55)) >> 2) & 0x33));
+    unsigned int tmp_flag = (uint8_t)((((wave.flags & 0x55) + ((wave.flags >> 1) & 0x55)) & 0x33) +
+        (((uint8_t)((wave.flags & 0x55) + ((wave.flags >> 1) & 0x55)) >> 2) & 0x33));
     if (wave.codec == 1)
     {
         if (wave.flags)
@@ -330,23 +672,60 @@ void WBK::SetNumSamples(nslWave& wave, int num_samples)
 }
 
 
+// fingerprint of the header and entry table; a cached seek index or an in-place write is only
+// used against the bank it was taken from
+static uint64_t table_fingerprint(std::span<const uint8_t> bytes, size_t table_end)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < std::min(table_end, bytes.size()); ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
 int WBK::parse(std::istream& stream, const bool DecodeTracks)
 {
+    if (!stream.good())
+        return WBK_PARSE_FAILED;
+
+    // read the whole bank once, everything else is parsed from memory
+    stream.seekg(0, std::ios::end);
+    size_t actual_file_size = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+    raw_data.resize(actual_file_size);
+    stream.read((char*)raw_data.data(), actual_file_size);
+
+    mapping.reset();
+    bank = raw_data;
+    return parse_bank(DecodeTracks);
+}
+
+int WBK::parse_bank(const bool DecodeTracks)
+{
+    Trace::Scope scope(g_trace, "parse");
+    scope.add(bank.size());
+    base_size = bank.size();
+    base_mtime = {};
+    dirty.clear();
+
     // stay fresh
     entries.clear();
     tracks.clear();
     metadata.clear();
-
-    if (stream.good()) 
     {
-        stream.seekg(0, std::ios::end);
-        size_t actual_file_size = stream.tellg();
-        stream.seekg(0, std::ios::beg);
-        raw_data.resize(actual_file_size);
-        stream.read((char*)raw_data.data(), actual_file_size);
+        std::lock_guard guard(cache.lock);
+        cache.clear();
+    }
 
-        stream.seekg(0, std::ios::beg);
-        stream.read(reinterpret_cast<char*>(&header), sizeof header_t);
+    // bounds-checked copy out of the bank, anything past the end reads as zeroes
+    auto read_at = [this](size_t offs, void* dst, size_t size) {
+        size_t avail = offs < bank.size() ? std::min(size, bank.size() - offs) : 0;
+        if (avail) std::memcpy(dst, bank.data() + offs, avail);
+        if (avail < size) std::memset(static_cast<char*>(dst) + avail, 0, size - avail);
+    };
+
+    if (bank.size() >= sizeof(header_t)) 
+    {
+        read_at(0, &header, sizeof(header_t));
 
         if (header.total_bytes >= INT_MAX) {
             printf("ERROR: Max file size, this WBK won't work in-game.\n");
@@ -360,8 +739,7 @@ int WBK::parse(std::istream& stream, const bool DecodeTracks)
         // read all entries
         for (int32_t index = 0; index < numEntries; ++index) {
             nslWave entry;
-            stream.seekg(sizeof header_t + (sizeof nslWave * index), std::ios::beg);
-            stream.read(reinterpret_cast<char*>(&entry), sizeof nslWave);
+            read_at(sizeof(header_t) + (sizeof(nslWave) * index), &entry, sizeof(nslWave));
 
             // calc bits per sample & blockAlign
             int bits_per_sample = 0;
@@ -413,49 +791,18 @@ int WBK::parse(std::istream& stream, const bool DecodeTracks)
             if (!DecodeTracks)
                 continue;
 
-            if (entry.codec == PCM || entry.codec == PCM2) {        // @todo: not seen these yet, but this won't work (seeks to 0x1000)
-                stream.seekg(0x1000, std::ios::beg);
-                std::vector<int16_t> tmp;
-                for (int i = 0; i < size / 4; ++i) {
-                    int16_t sample1, sample2;
-                    stream.read(reinterpret_cast<char*>(&sample1), 2);
-                    stream.read(reinterpret_cast<char*>(&sample2), 2);
-                    tmp.push_back(sample1);
-                    tmp.push_back(sample2);
-                }
-                tracks.push_back(tmp);
-            }
-            // both IMA ADPCM and ADPCM (and other variants)
-            else if (entry.codec >= Reserved && entry.codec <= IMA_ADPCM) {
-                if (entry.codec == ADPCM_2)
-                    SetNumChannels(entry, 1);
-
-                std::vector<uint8_t> bdata;
-                stream.seekg(entry.compressed_data_offs, std::ios::beg);
-                auto samples_size = entry.num_bytes;
-                bdata.resize(samples_size);
-                stream.read((char*)bdata.data(), samples_size);
-                bdata.shrink_to_fit();
-
-                auto decoded_samples = decode(bdata, entry);
-                bdata.clear();
-                decoded_samples.shrink_to_fit();
-                tracks.push_back(decoded_samples);
-            }
-            else
-                throw std::runtime_error((std::ostringstream{} << "Unsupported codec (" << entry.codec << ")").str());
-
+            tracks.push_back(std::make_shared<const std::vector<int16_t>>(decode_track(index)));
         }
 
         // read metadata
+        size_t group_offs = sizeof(header_t) + sizeof(nslWave) * size_t(std::max(numEntries, 0));
         if (header.metadata_offs) {
-            size_t num_metadata = (header.entry_desc_offs - header.metadata_offs) / sizeof metadata_t;
+            size_t num_metadata = (header.entry_desc_offs - header.metadata_offs) / sizeof(metadata_t);
             if (num_metadata) {
                 metadata.reserve(num_metadata);
-                stream.seekg(header.metadata_offs, std::ios::beg);
                 for (int index = 0; index < num_metadata; ++index) {
                     metadata_t tmp_metadata;
-                    stream.read(reinterpret_cast<char*>(&tmp_metadata), sizeof metadata_t);
+                    read_at(header.metadata_offs + sizeof(metadata_t) * index, &tmp_metadata, sizeof(metadata_t));
                     if (tmp_metadata.codec != 0) {
                         metadata.push_back(tmp_metadata);
 #                       if _DEBUG
@@ -465,150 +812,709 @@ int WBK::parse(std::istream& stream, const bool DecodeTracks)
 #                       endif
                     }
                 }
+                group_offs = header.metadata_offs + sizeof(metadata_t) * num_metadata;
             }
         }
 
         entries.shrink_to_fit();
         tracks.shrink_to_fit();
 
-        stream.read(reinterpret_cast<char*>(&bank_group), 16);
+        read_at(group_offs, &bank_group, 16);
         if (bank_group[0] != 0)
             printf("Bank Type: %s\n", std::string(bank_group).c_str());
+        base_fingerprint = table_fingerprint(bank, sizeof(header_t) + sizeof(nslWave) * entries.size());
         return WBK_OK;
     }
     return WBK_PARSE_FAILED;
 }
 
+int WBK::write_in_place(std::filesystem::path path)
+{
+    if (header.total_bytes >= INT_MAX)
+        return WBK_FILE_TOO_LARGE;
+
+    // only valid against the file this bank was read from, untouched since: same size, same
+    // modification time (when read from a path) and same header and entry table
+    std::error_code ec;
+    const auto on_disk = std::filesystem::file_size(path, ec);
+    if (ec || on_disk != base_size)
+        return WBK_WRITE_ERROR;
+    if (base_mtime != std::filesystem::file_time_type{} && std::filesystem::last_write_time(path, ec) != base_mtime)
+        return WBK_WRITE_ERROR;
+    const size_t table_end = sizeof(header_t) + sizeof(nslWave) * entries.size();
+
+    Trace::Scope scope(g_trace, "write_in_place");
+    std::sort(dirty.begin(), dirty.end());
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (const auto& [begin, end] : dirty) {
+        if (!ranges.empty() && begin <= ranges.back().second)
+            ranges.back().second = std::max(ranges.back().second, end);
+        else
+            ranges.emplace_back(begin, end);
+    }
+
+    {
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<uint8_t> table(std::min(table_end, base_size));
+        fs.read(reinterpret_cast<char*>(table.data()), std::streamsize(table.size()));
+        if (!fs.good() || table_fingerprint(table, table.size()) != base_fingerprint)
+            return WBK_WRITE_ERROR;
+        for (const auto& [begin, end] : ranges) {
+            const size_t stop = std::min(end, bank.size());
+            if (begin >= stop)
+                continue;
+            fs.seekp(std::streamoff(begin));
+            fs.write(reinterpret_cast<const char*>(bank.data() + begin), std::streamsize(stop - begin));
+            scope.add(stop - begin);
+        }
+        if (!fs.good())
+            return WBK_WRITE_ERROR;
+    }
+    if (bank.size() < base_size) {
+        std::filesystem::resize_file(path, bank.size(), ec);
+        if (ec)
+            return WBK_WRITE_ERROR;
+    }
+
+    base_size = bank.size();
+    base_fingerprint = table_fingerprint(bank, table_end);
+    base_mtime = std::filesystem::last_write_time(path, ec);
+    dirty.clear();
+    return WBK_OK;
+}
+
 int WBK::write(std::filesystem::path path) {
+    Trace::Scope scope(g_trace, "write_bank");
+    scope.add(bank.size());
     if (header.total_bytes >= INT_MAX)
         return WBK_FILE_TOO_LARGE;
 
     std::ofstream ofs(path, std::ios::binary);
     if (ofs.good()) {
-        ofs.write((char*)raw_data.data(), raw_data.size());
+        ofs.write((const char*)bank.data(), bank.size());
         ofs.close();
         return WBK_OK;
     }
     return WBK_WRITE_ERROR;
 }
 
-std::vector<uint8_t> WBK::encode(const WAV& wav, Codec codec)
+std::vector<uint8_t> WBK::encode(const WAV& wav, Codec codec, const EncodeOptions& options)
 {
     std::vector<uint8_t> res;
 
-    if (codec == IMA_ADPCM)
-        res = EncodeImaAdpcm(wav.samples, wav.header.numChannels);
-    else if (codec == ADPCM_1)
-    {
-        std::vector<int16_t> pcmSamples(wav.samples.size() / 2);
-        std::memcpy(pcmSamples.data(), wav.samples.data(), wav.samples.size());
+    // encoders read the samples straight out of the WAV's mapping; PCM targets are stored elsewhere
+    if (codec == PCM || codec == PCM2)
+        return res;
+
+    const int channels = wav.header.numChannels;
+    res.resize(GetEncodedSize(codec, wav.pcm().size() / std::max(channels, 1), channels));
+    res.resize(encode(wav.pcm(), channels, codec, res, options));
+    return res;
+}
 
-        res = EncodeAdpcm1(pcmSamples, wav.header.numChannels);
+size_t WBK::encode(std::span<const int16_t> pcm, int channels, Codec codec, std::span<uint8_t> out, const EncodeOptions& options)
+{
+    const codec_t* c = GetCodec(codec);
+    if (!c)
+        return 0;
+
+    Trace::Scope scope(g_trace, "encode", c->name);
+    scope.add(pcm.size_bytes(), pcm.size());
+    return c->encode(pcm, channels, out, options);
+}
+
+std::vector<int16_t> WBK::decode(std::span<const uint8_t> payload, const nslWave& entry, unsigned threads)
+{
+    std::vector<int16_t> decoded_samples(GetDecodedSamples(entry, payload));
+    decoded_samples.resize(decode(payload, entry, decoded_samples, threads));
+    return decoded_samples;
+}
+
+size_t WBK::decode(std::span<const uint8_t> payload, const nslWave& entry, std::span<int16_t> out, unsigned threads)
+{
+    const codec_t* c = GetCodec(entry.codec);
+    if (!c)
+        return 0;
+
+    Trace::Scope scope(g_trace, "decode", c->name);
+    const size_t written = c->decode(payload, GetDecodeChannels(entry), out, threads);
+    scope.add(written * sizeof(int16_t), written);
+    return written;
+}
+
+
+
+std::vector<int16_t> WBK::decode_track(int index) const
+{
+    if (index < 0 || index >= (int)entries.size())
+        return {};
+
+    nslWave entry = entries[index];
+    if (entry.codec == PCM || entry.codec == PCM2) {        // @todo: not seen these yet, but this won't work (reads from 0x1000)
+        std::vector<int16_t> tmp((entry.num_bytes / 4) * 2);
+        const size_t avail = bank.size() > 0x1000 ? std::min(tmp.size() * sizeof(int16_t), bank.size() - 0x1000) : 0;
+        if (avail)
+            std::memcpy(tmp.data(), bank.data() + 0x1000, avail);
+        return tmp;
     }
-    else if (codec == ADPCM_2)
-    {
-        std::vector<int16_t> pcmSamples(wav.samples.size() / 2);
-        std::memcpy(pcmSamples.data(), wav.samples.data(), wav.samples.size());
+    // both IMA ADPCM and ADPCM (and other variants)
+    else if (entry.codec >= Reserved && entry.codec <= IMA_ADPCM) {
+        return decode(payload(index), entry, decode_threads);
+    }
+    else
+        throw std::runtime_error((std::ostringstream{} << "Unsupported codec (" << entry.codec << ")").str());
+}
 
-        res = EncodeAdpcm2(pcmSamples, wav.header.numChannels);
+TrackDecoder WBK::open_track(int index) const
+{
+    if (index < 0 || index >= (int)entries.size())
+        return TrackDecoder(nslWave{}, {});
+
+    const nslWave& entry = entries[index];
+    if (entry.codec == PCM || entry.codec == PCM2) {        // same source as decode_track(), see the @todo there
+        const size_t size = (entry.num_bytes / 4) * 4;
+        if (bank.size() <= 0x1000)
+            return TrackDecoder(entry, {});
+        return TrackDecoder(entry, bank.subspan(0x1000, std::min(size, bank.size() - 0x1000)));
     }
+    return TrackDecoder(entry, payload(index));
+}
 
-    return res;
+void WBK::build_seek_index(unsigned interval)
+{
+    // checkpoints have to land on ADPCM_1 frame (28 samples) and IMA byte boundaries
+    interval = std::max(28u, (interval + 27) / 28 * 28);
+    seek_interval = interval;
+    seek_index.assign(entries.size(), {});
+
+    std::vector<int16_t> scratch(interval);
+    for (int i = 0; i < (int)entries.size(); ++i) {
+        if (entries[i].codec != ADPCM_1 && entries[i].codec != IMA_ADPCM)
+            continue;
+
+        auto& points = seek_index[i];
+        TrackDecoder decoder = open_track(i);
+        while (decoder.read(scratch) == interval && !decoder.done())
+            points.push_back(decoder.checkpoint());
+    }
 }
-std::vector<int16_t> WBK::decode(std::vector<uint8_t> samples, const nslWave& entry)
+
+int WBK::save_seek_index(std::filesystem::path path) const
 {
-    std::vector<int16_t> decoded_samples(2 * samples.size());
-    switch (entry.codec) {
-        case ADPCM_1: {
-            decoded_samples = DecodeAdpcm1(samples);
-            break;
-        }
-        case ADPCM_2: {
-            decoded_samples = DecodeAdpcm2(samples, GetNumChannels(entry));
-            break;
-        }
-        case IMA_ADPCM: {
-            decoded_samples = DecodeImaAdpcm(samples, GetNumChannels(entry));
-            break;
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs.good())
+        return WBK_WRITE_ERROR;
+
+    const uint64_t fingerprint = table_fingerprint(bank, sizeof(header_t) + sizeof(nslWave) * entries.size());
+    const uint32_t num_tracks = static_cast<uint32_t>(seek_index.size());
+    ofs.write("WBKSEEK1", 8);
+    ofs.write(reinterpret_cast<const char*>(&fingerprint), sizeof fingerprint);
+    ofs.write(reinterpret_cast<const char*>(&seek_interval), sizeof seek_interval);
+    ofs.write(reinterpret_cast<const char*>(&num_tracks), sizeof num_tracks);
+    for (const auto& points : seek_index) {
+        const uint32_t count = static_cast<uint32_t>(points.size());
+        ofs.write(reinterpret_cast<const char*>(&count), sizeof count);
+        ofs.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(TrackSeekPoint));
+    }
+    return ofs.good() ? WBK_OK : WBK_WRITE_ERROR;
+}
+
+int WBK::load_seek_index(std::filesystem::path path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.good())
+        return WBK_PARSE_FAILED;
+
+    char magic[8];
+    uint64_t fingerprint = 0;
+    uint32_t interval = 0, num_tracks = 0;
+    ifs.read(magic, 8);
+    ifs.read(reinterpret_cast<char*>(&fingerprint), sizeof fingerprint);
+    ifs.read(reinterpret_cast<char*>(&interval), sizeof interval);
+    ifs.read(reinterpret_cast<char*>(&num_tracks), sizeof num_tracks);
+    if (!ifs.good() || std::memcmp(magic, "WBKSEEK1", 8) != 0)
+        return WBK_PARSE_FAILED;
+    if (num_tracks != entries.size() || fingerprint != table_fingerprint(bank, sizeof(header_t) + sizeof(nslWave) * entries.size()))
+        return WBK_STALE_SEEK_INDEX;
+
+    std::vector<std::vector<TrackSeekPoint>> loaded(num_tracks);
+    for (auto& points : loaded) {
+        uint32_t count = 0;
+        ifs.read(reinterpret_cast<char*>(&count), sizeof count);
+        points.resize(count);
+        ifs.read(reinterpret_cast<char*>(points.data()), points.size() * sizeof(TrackSeekPoint));
+        if (!ifs.good())
+            return WBK_PARSE_FAILED;
+    }
+    seek_index.swap(loaded);
+    seek_interval = interval;
+    return WBK_OK;
+}
+
+size_t WBK::decode_range(int index, size_t first_sample, std::span<int16_t> out) const
+{
+    TrackDecoder decoder = open_track(index);
+    if (index >= 0 && index < (int)seek_index.size())
+        decoder.seek(first_sample, seek_index[index]);
+    else
+        decoder.seek(first_sample);
+
+    size_t written = 0;
+    while (written < out.size()) {
+        const size_t n = decoder.read(out.subspan(written));
+        if (!n) break;
+        written += n;
+    }
+    return written;
+}
+
+void WBK::track_cache_t::evict(int index)
+{
+    if (auto it = items.find(index); it != items.end()) {
+        used -= it->second.first->size() * sizeof(int16_t);
+        lru.erase(it->second.second);
+        items.erase(it);
+    }
+}
+
+void WBK::track_cache_t::trim()
+{
+    // the most recent track always stays, even if it alone is over budget
+    while (used > budget && lru.size() > 1)
+        evict(lru.back());
+}
+
+void WBK::track_cache_t::clear()
+{
+    items.clear();
+    lru.clear();
+    used = 0;
+}
+
+WBK& WBK::operator=(const WBK& other)
+{
+    if (this == &other)
+        return *this;
+    header = other.header;
+    entries = other.entries;
+    tracks = other.tracks;
+    metadata = other.metadata;
+    std::memcpy(bank_group, other.bank_group, sizeof(bank_group));
+    decode_threads = other.decode_threads;
+    raw_data = other.raw_data;
+    mapping = other.mapping;
+    // a mapped bank stays in the shared mapping, an owned one is viewed through this copy's raw_data
+    bank = mapping ? other.bank : std::span<const uint8_t>(raw_data);
+    cache = other.cache;
+    seek_index = other.seek_index;
+    seek_interval = other.seek_interval;
+    base_size = other.base_size;
+    base_fingerprint = other.base_fingerprint;
+    base_mtime = other.base_mtime;
+    dirty = other.dirty;
+    return *this;
+}
+
+void WBK::set_track_cache_budget(size_t bytes)
+{
+    std::lock_guard guard(cache.lock);
+    cache.budget = bytes;
+    cache.trim();
+}
+
+WBK::track_ptr WBK::track(int index)
+{
+    if (index < 0 || index >= (int)entries.size())
+        return nullptr;
+
+    // already decoded by parse(..., DecodeTracks = true)
+    if (index < (int)tracks.size())
+        return tracks[index];
+
+    {
+        std::lock_guard guard(cache.lock);
+        if (auto it = cache.items.find(index); it != cache.items.end()) {
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second.second);
+            return it->second.first;
         }
     }
-    return decoded_samples;
+
+    // decode outside the lock, two threads racing on the same track just decode it twice
+    auto decoded = std::make_shared<const std::vector<int16_t>>(decode_track(index));
+
+    std::lock_guard guard(cache.lock);
+    if (auto it = cache.items.find(index); it != cache.items.end())
+        return it->second.first;
+    cache.lru.push_front(index);
+    cache.items.emplace(index, std::make_pair(decoded, cache.lru.begin()));
+    cache.used += decoded->size() * sizeof(int16_t);
+    cache.trim();
+    return decoded;
 }
 
+WBK::track_ptr WBK::track(string_hash hash)
+{
+    auto it = std::find_if(entries.begin(), entries.end(), [hash](const nslWave& p) { return p.hash == hash.hash; });
+    if (it == entries.end())
+        return nullptr;
+    return track(int(std::distance(entries.begin(), it)));
+}
 
+int WBK::replace(string_hash hash, const WAV& wav, Codec codec, const EncodeOptions& options)
+{
+    auto it = std::find_if(entries.begin(), entries.end(), [hash](const nslWave& p) { return p.hash == hash.hash; });
+    if (it != entries.end())
+        return replace(int(std::distance(entries.begin(), it)), wav, codec, options);
+    return WBK_HASH_NOT_FOUND;
+}
+
+int WBK::replace(int replacement_index, const WAV& wav, Codec codec, const EncodeOptions& options)
+{
+    ReplacePlan plan(*this, options);
+    if (int res = plan.add(replacement_index, wav, codec); res != WBK_OK)
+        return res;
+    return replace(plan);
+}
 
-int WBK::replace(string_hash hash, const WAV& wav, Codec codec)
+int WBK::ReplacePlan::add(string_hash hash, const WAV& wav, Codec codec)
 {
+    const auto& entries = wbk.entries;
     auto it = std::find_if(entries.begin(), entries.end(), [hash](const nslWave& p) { return p.hash == hash.hash; });
     if (it != entries.end())
-        return replace(int(std::distance(entries.begin(), it)), wav, codec);
+        return add(int(std::distance(entries.begin(), it)), wav, codec);
     return WBK_HASH_NOT_FOUND;
 }
 
-int WBK::replace(int replacement_index, const WAV& wav, Codec codec)
+WBK::Codec WBK::ReplacePlan::target_codec(int replacement_index, Codec codec) const
 {
-    if (replacement_index < 0 || replacement_index >= header.num_entries)
+    if (codec != Keep || replacement_index < 0 || replacement_index >= (int)wbk.entries.size())
+        return codec;
+    return wbk.entries[replacement_index].codec;
+}
+
+int WBK::ReplacePlan::add(int replacement_index, const WAV& wav, Codec codec)
+{
+    if (replacement_index < 0 || replacement_index >= wbk.header.num_entries)
         return WBK_INVALID_REPLACE_INDEX;
 
-    const nslWave orig = entries[replacement_index];
-    const Codec target_codec = (codec == Keep ? orig.codec : codec);
+    const Codec target = target_codec(replacement_index, codec);
+    return add(replacement_index, wav, target, encode(wav, target, options));
+}
 
-    // copy everything from the original up until the track data we want to replace
-    std::vector<uint8_t> encoded_samples = encode(wav, target_codec);
-    std::vector<uint8_t> new_raw_data(raw_data.begin(), raw_data.begin() + orig.compressed_data_offs);
+int WBK::ReplacePlan::add(int replacement_index, const WAV& wav, Codec codec, std::vector<uint8_t> encoded)
+{
+    if (replacement_index < 0 || replacement_index >= wbk.header.num_entries)
+        return WBK_INVALID_REPLACE_INDEX;
 
-    // insert the new track samples and calc the next available data offset
-    size_t next_data_offset = (orig.compressed_data_offs + encoded_samples.size() + 0x7FFF) & ~size_t(0x7FFF);
-    new_raw_data.insert(new_raw_data.end(), encoded_samples.begin(), encoded_samples.end());
-    new_raw_data.insert(new_raw_data.end(), next_data_offset - new_raw_data.size(), 0x00);
+    staged_t& item = staged[replacement_index];
+    item.codec = target_codec(replacement_index, codec);
+    item.num_channels = wav.header.numChannels;
+    item.sample_rate = wav.header.sampleRate;
+    item.pcm_bytes = wav.pcm_bytes();
+    item.encoded = std::move(encoded);
+    return WBK_OK;
+}
 
+// sorted, unique payload offsets; entry order and payload order need not agree
+std::vector<size_t> WBK::payload_offsets() const
+{
+    std::vector<size_t> offsets;
+    offsets.reserve(entries.size());
+    for (const auto& e : entries)
+        offsets.push_back(size_t(e.compressed_data_offs));
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    return offsets;
+}
 
-    // for each entry after the replaced one, we insert it at the right location and modify its start offset.
-    for (int index = replacement_index + 1; index < header.num_entries; ++index) 
-    {
-        size_t data_start = entries[index].compressed_data_offs;
-        size_t data_end = (index + 1 != header.num_entries) ? 
-                            entries[index + 1].compressed_data_offs : raw_data.size();
-        size_t data_size = data_end - data_start;
+// a slot runs from a payload's offset to the next higher payload offset (or the end of the bank)
+size_t WBK::slot_end(std::span<const size_t> offsets, size_t offs) const
+{
+    auto it = std::upper_bound(offsets.begin(), offsets.end(), offs);
+    return std::max(offs, it != offsets.end() ? *it : bank.size());
+}
 
-        auto* new_entry = reinterpret_cast<nslWave*>(new_raw_data.data() + sizeof header_t + (sizeof nslWave * index));
-        new_entry->compressed_data_offs = static_cast<int>(next_data_offset);
+// Word-wise FNV-1a of a payload, seeded with its size; fingerprints payloads for dedupe and the bank catalog
+inline uint64_t PayloadHash(std::span<const uint8_t> bytes)
+{
+    uint64_t h = 0xcbf29ce484222325ull ^ bytes.size();
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        h = (h ^ word) * 0x100000001b3ull;
+    }
+    for (; i < bytes.size(); ++i)
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    return h ^ (h >> 32);
+}
 
-        new_raw_data.insert(new_raw_data.end(), raw_data.begin() + data_start, raw_data.begin() + data_end);
-        next_data_offset = (next_data_offset + data_size + 0x7FFF) & ~size_t(0x7FFF);
-        new_raw_data.insert(new_raw_data.end(), next_data_offset - new_raw_data.size(), 0x00);
+// Payloads seen so far by a dedupe pass, bucketed by PayloadHash(); a match is only reported after a full compare
+class payload_index_t {
+public:
+    std::optional<size_t> find(std::span<const uint8_t> bytes) const
+    {
+        if (bytes.empty())
+            return std::nullopt;
+        auto [first, last] = seen.equal_range(PayloadHash(bytes));
+        for (auto it = first; it != last; ++it)
+            if (it->second.first.size() == bytes.size() && std::memcmp(it->second.first.data(), bytes.data(), bytes.size()) == 0)
+                return it->second.second;
+        return std::nullopt;
+    }
+    void add(std::span<const uint8_t> bytes, size_t offs)
+    {
+        if (!bytes.empty())
+            seen.emplace(PayloadHash(bytes), std::make_pair(bytes, offs));
     }
 
+private:
+    std::unordered_multimap<uint64_t, std::pair<std::span<const uint8_t>, size_t>> seen;   // -> bytes, offset
+};
 
+void WBK::apply_staged(nslWave& replaced, const ReplacePlan::staged_t& item)
+{
     // update codec
-    auto* replaced = reinterpret_cast<nslWave*>(new_raw_data.data() + sizeof header_t + ( sizeof nslWave * replacement_index ));
-    replaced->codec = target_codec;
+    replaced.codec = item.codec;
 
     // update channels
-    if (GetNumChannels(*replaced) != wav.header.numChannels)
-        SetNumChannels(*replaced, wav.header.numChannels);
+    if (GetNumChannels(replaced) != item.num_channels)
+        SetNumChannels(replaced, item.num_channels);
 
     // update sample rate
-    replaced->samples_per_second = static_cast<unsigned short>(wav.header.sampleRate);
+    replaced.samples_per_second = static_cast<unsigned short>(item.sample_rate);
 
-    if (target_codec == PCM || target_codec == PCM2) {
-        replaced->num_bytes = static_cast<unsigned>(wav.samples.size());
-        replaced->num_samples = GetNumSamples(*replaced);
+    if (item.codec == PCM || item.codec == PCM2) {
+        replaced.num_bytes = static_cast<unsigned>(item.pcm_bytes);
+        replaced.num_samples = GetNumSamples(replaced);
     }
     else {
-        replaced->num_bytes = static_cast<unsigned>(encoded_samples.size());
-        const int ch = wav.header.numChannels ? wav.header.numChannels : 1;
-        const int frames = int(wav.samples.size() / (2 * ch));
-        replaced->num_samples = frames;
+        replaced.num_bytes = static_cast<unsigned>(item.encoded.size());
+        const int ch = item.num_channels ? item.num_channels : 1;
+        const int frames = int(item.pcm_bytes / (2 * ch));
+        replaced.num_samples = frames;
+    }
+}
+
+int WBK::replace_in_slots(const ReplacePlan& plan, dedupe_stats_t* stats)
+{
+    const int num_entries = header.num_entries;
+    if (plan.staged.begin()->first < 0 || plan.staged.rbegin()->first >= num_entries)
+        return WBK_INVALID_REPLACE_INDEX;
+
+    auto align = [](size_t v) { return (v + 0x7FFF) & ~size_t(0x7FFF); };
+
+    const std::vector<size_t> offsets = payload_offsets();
+    std::unordered_map<size_t, int> users;
+    for (const auto& e : entries)
+        users[size_t(e.compressed_data_offs)]++;
+
+    // with dedupe, only payloads that stay and have the size of a replacement can match it
+    payload_index_t seen;
+    if (plan.dedupe) {
+        std::unordered_set<size_t> sizes;
+        for (const auto& [index, item] : plan.staged)
+            sizes.insert(item.encoded.size());
+        for (int index = 0; index < num_entries; ++index)
+            if (!plan.staged.count(index) && sizes.count(payload(index).size()))
+                seen.add(payload(index), size_t(entries[index].compressed_data_offs));
+    }
+
+    // keep the slot when the payload fits and no other entry points at it, otherwise append;
+    // a payload that is already in the bank is not written at all
+    struct placed_t { int index; size_t offs; size_t slot_end; bool moved; bool shared; };
+    std::vector<placed_t> placed;
+    size_t new_size = align(bank.size());
+    for (const auto& [index, item] : plan.staged) {
+        if (auto shared = seen.find(item.encoded)) {
+            placed.push_back({ index, *shared, *shared, false, true });
+            if (stats) {
+                stats->shared_entries++;
+                stats->bytes_saved += align(item.encoded.size());
+            }
+            continue;
+        }
+        const size_t offs = size_t(entries[index].compressed_data_offs);
+        const size_t end = slot_end(offsets, offs);
+        if (offs <= bank.size() && item.encoded.size() <= end - offs && users[offs] == 1)
+            placed.push_back({ index, offs, end, false, false });
+        else {
+            placed.push_back({ index, new_size, align(new_size + item.encoded.size()), true, false });
+            new_size = placed.back().slot_end;
+        }
+        if (plan.dedupe)
+            seen.add(item.encoded, placed.back().offs);
     }
+    if (!std::any_of(placed.begin(), placed.end(), [](const placed_t& p) { return p.moved; }))
+        new_size = bank.size();
+    if (new_size >= INT_MAX)
+        return WBK_FILE_TOO_LARGE;
 
-    // update the total bytes and parse again
+    Trace::Scope scope(g_trace, "replace");
+    std::vector<uint8_t> new_raw_data(new_size, 0x00);
+    std::memcpy(new_raw_data.data(), bank.data(), bank.size());
+
+    auto* new_entries = reinterpret_cast<nslWave*>(new_raw_data.data() + sizeof(header_t));
+    for (const auto& p : placed) {
+        const auto& item = plan.staged.at(p.index);
+        if (!p.shared) {
+            uint8_t* dst = new_raw_data.data() + p.offs;
+            std::memcpy(dst, item.encoded.data(), item.encoded.size());
+            std::memset(dst + item.encoded.size(), 0, p.slot_end - p.offs - item.encoded.size());
+            scope.add(p.slot_end - p.offs);
+            mark_dirty(p.offs, p.slot_end);
+        }
+
+        new_entries[p.index].compressed_data_offs = static_cast<int>(p.offs);
+        apply_staged(new_entries[p.index], item);
+        const size_t record = sizeof(header_t) + sizeof(nslWave) * size_t(p.index);
+        mark_dirty(record, record + sizeof(nslWave));
+    }
+
+    if (new_size != bank.size()) {
+        mark_dirty(bank.size(), new_size);      // padding up to the first moved payload
+        reinterpret_cast<header_t*>(new_raw_data.data())->total_bytes = static_cast<int>(new_size);
+        header.total_bytes = static_cast<int>(new_size);
+        mark_dirty(0, sizeof(header_t));
+    }
+
+    raw_data.swap(new_raw_data);
+    mapping.reset();
+    bank = raw_data;
+    entries.assign(new_entries, new_entries + num_entries);
+    tracks.clear();
+    {
+        std::lock_guard guard(cache.lock);
+        for (const auto& [index, item] : plan.staged)
+            cache.evict(index);
+    }
+    return WBK_OK;
+}
+
+int WBK::replace(const ReplacePlan& plan, dedupe_stats_t* stats)
+{
+    if (stats)
+        *stats = {};
+    if (plan.staged.empty() && !plan.dedupe)
+        return WBK_OK;
+    const int num_entries = header.num_entries;
+    if (!plan.staged.empty() && (plan.staged.begin()->first < 0 || plan.staged.rbegin()->first >= num_entries))
+        return WBK_INVALID_REPLACE_INDEX;
+    if (plan.layout == Layout::KeepOffsets)
+        return plan.staged.empty() ? WBK_OK : replace_in_slots(plan, stats);
+    if (num_entries == 0)
+        return WBK_OK;
+
+    auto align = [](size_t v) { return (v + 0x7FFF) & ~size_t(0x7FFF); };
+
+    // everything before the cut is kept as-is: the payload of the first replaced track, or with
+    // dedupe the first payload of the bank, since any two payloads may turn out to be equal
+    const std::vector<size_t> offsets = payload_offsets();
+    const size_t table_end = sizeof(header_t) + sizeof(nslWave) * size_t(num_entries);
+    const size_t cut = plan.dedupe ? *std::lower_bound(offsets.begin(), offsets.end() - 1, table_end)
+                                   : size_t(entries[plan.staged.begin()->first].compressed_data_offs);
+
+    // work out the final offsets first, in entry order; entries that already shared a payload keep sharing it
+    struct span_t { size_t src; size_t size; size_t dst; const std::vector<uint8_t>* encoded; };
+    std::vector<span_t> layout;
+    std::vector<size_t> new_offsets(num_entries);
+    std::unordered_map<size_t, size_t> moved;      // old offset -> new offset of payloads already laid out
+    payload_index_t seen;
+
+    size_t next_data_offset = cut;
+    for (int index = 0; index < num_entries; ++index)
+    {
+        const size_t offs = size_t(entries[index].compressed_data_offs);
+        auto it = plan.staged.find(index);
+        if (it == plan.staged.end()) {
+            if (offs < cut) {
+                new_offsets[index] = offs;
+                continue;
+            }
+            if (auto m = moved.find(offs); m != moved.end()) {
+                new_offsets[index] = m->second;
+                continue;
+            }
+        }
+
+        span_t s{};
+        std::span<const uint8_t> bytes;
+        if (it != plan.staged.end()) {
+            s.encoded = &it->second.encoded;
+            s.size = s.encoded->size();
+            bytes = *s.encoded;
+        }
+        else {
+            s.src = offs;
+            s.size = slot_end(offsets, offs) - offs;
+            bytes = payload(index);
+        }
+
+        if (auto shared = seen.find(bytes)) {
+            new_offsets[index] = *shared;
+            if (!s.encoded)
+                moved.emplace(offs, *shared);
+            if (stats) {
+                stats->shared_entries++;
+                stats->bytes_saved += align(s.size);
+            }
+            continue;
+        }
+
+        s.dst = next_data_offset;
+        new_offsets[index] = s.dst;
+        if (!s.encoded)
+            moved.emplace(offs, s.dst);
+        if (plan.dedupe)
+            seen.add(bytes, s.dst);
+        next_data_offset = align(next_data_offset + s.size);
+        layout.push_back(s);
+    }
+    if (next_data_offset >= INT_MAX)
+        return WBK_FILE_TOO_LARGE;
+
+    // assemble the new bank in one go
+    Trace::Scope scope(g_trace, "replace");
+    scope.add(next_data_offset);
+    std::vector<uint8_t> new_raw_data(next_data_offset, 0x00);
+    std::memcpy(new_raw_data.data(), bank.data(), cut);
+    for (const auto& s : layout) {
+        const uint8_t* src = s.encoded ? s.encoded->data() : bank.data() + s.src;
+        std::memcpy(new_raw_data.data() + s.dst, src, s.size);
+    }
+
+    auto* new_entries = reinterpret_cast<nslWave*>(new_raw_data.data() + sizeof(header_t));
+    for (int index = 0; index < num_entries; ++index)
+        new_entries[index].compressed_data_offs = static_cast<int>(new_offsets[index]);
+
+    for (const auto& [index, item] : plan.staged)
+        apply_staged(new_entries[index], item);
+
+    // everything from the entry table's first moved payload on is new
+    mark_dirty(0, table_end);
+    mark_dirty(cut, new_raw_data.size());
+
+    // update the total bytes; the entry table is refreshed from the new bank, no reparse needed
     reinterpret_cast<header_t*>(new_raw_data.data())->total_bytes = static_cast<int>(new_raw_data.size());
+    header.total_bytes = static_cast<int>(new_raw_data.size());
     raw_data.swap(new_raw_data);
-    std::vector<uint8_t> tmp = raw_data; // yes, a copy, but only during replace()
-    membuf sbuf(reinterpret_cast<const char*>(tmp.data()), tmp.size());
-    std::istream s(&sbuf);
-    parse(s, false);
+    mapping.reset();
+    bank = raw_data;
+    entries.assign(new_entries, new_entries + num_entries);
+    tracks.clear();
+    {
+        // only the replaced tracks decode differently now
+        std::lock_guard guard(cache.lock);
+        for (const auto& [index, item] : plan.staged)
+            cache.evict(index);
+    }
 
     return WBK_OK;
-}
\ No newline at end of file
+}
+
+int WBK::dedupe(dedupe_stats_t* stats)
+{
+    ReplacePlan plan(*this);
+    plan.dedupe = true;
+    return replace(plan, stats);
+}
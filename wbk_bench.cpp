@@ -0,0 +1,447 @@
+// wbk_bench.cpp - codec and bank-operation benchmarks for wbk_tool, results as JSON
+// Usage:
+//   wbk_bench [-o <results.json>] [-f <filter>] [-t <seconds>] [-s <seconds of audio>] [-n <entries>] [-j <threads>]
+//
+// Notes:
+// - -o file : write the results to file (default: stdout); progress always goes to stderr
+// - -f text : only run benchmarks whose name contains text, e.g. -f adpcm1 or -f bank/
+// - -t sec  : minimum measuring time per benchmark (default: 0.5)
+// - -s sec  : length of the synthetic 44.1 kHz signal used for the codec benchmarks (default: 10)
+// - -n N    : entries in the synthetic bank used by the parse/replace benchmarks (default: 64)
+// - -j N    : threads handed to the encoders/decoders that can use them (default: 1)
+// - Each result reports the best and mean time per iteration; throughput is computed from the best run,
+//   bytes are PCM bytes for codec and wav/ benchmarks, bank bytes for bank benchmarks and dictionary bytes for dict/
+// - "ref" benchmarks run the original floating-point/serial kernels that the current ones replaced
+
+#include "wbk.h"
+#include "wbk_synth.h"
+#include "hash_dictionary.h"
+#include "hash_crack.h"
+#include "parallel.h"
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct result_t {
+    std::string name;
+    size_t iterations = 0;
+    double best_seconds = 0.0;
+    double mean_seconds = 0.0;
+    uint64_t bytes = 0;         // processed per iteration
+    uint64_t samples = 0;       // processed per iteration (all channels)
+};
+
+struct bench_options_t {
+    const char* filter = nullptr;
+    double min_seconds = 0.5;
+    double signal_seconds = 10.0;
+    int bank_entries = 64;
+    unsigned threads = 1;
+};
+
+bench_options_t g_options;
+std::vector<result_t> g_results;
+
+bool selected(const std::string& name)
+{
+    return !g_options.filter || name.find(g_options.filter) != std::string::npos;
+}
+
+// Runs setup() (untimed) and body() (timed) until min_seconds of body time and at least 3 runs
+void run(const std::string& name, uint64_t bytes, uint64_t samples,
+         const std::function<void()>& setup, const std::function<void()>& body)
+{
+    if (!selected(name))
+        return;
+
+    result_t res;
+    res.name = name;
+    res.bytes = bytes;
+    res.samples = samples;
+    res.best_seconds = 1e300;
+
+    double total = 0.0;
+    while (res.iterations < 3 || total < g_options.min_seconds) {
+        if (setup) setup();
+        const auto t0 = std::chrono::steady_clock::now();
+        body();
+        const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        res.best_seconds = std::min(res.best_seconds, dt);
+        total += dt;
+        ++res.iterations;
+    }
+    res.mean_seconds = total / res.iterations;
+
+    std::fprintf(stderr, "%-40s %8.3f ms  %10.2f MB/s\n", name.c_str(), res.best_seconds * 1e3,
+                 res.bytes / res.best_seconds / 1e6);
+    g_results.push_back(res);
+}
+
+std::vector<int16_t> make_signal(size_t frames, int channels, uint32_t seed = 1)
+{
+    std::vector<int16_t> pcm(frames * channels);
+    SynthSignal(pcm, channels, 44100, seed);
+    return pcm;
+}
+
+WBK::nslWave make_entry(WBK::Codec codec, int channels, size_t frames, size_t payload_bytes)
+{
+    WBK::nslWave entry{};
+    entry.codec = codec;
+    WBK::SetNumChannels(entry, channels);
+    entry.num_samples = int(frames);
+    entry.num_bytes = unsigned(payload_bytes);
+    entry.samples_per_second = 44100;
+    return entry;
+}
+
+// codecs cycle through ADPCM_1, IMA_ADPCM and ADPCM_2, odd entries are stereo
+std::vector<uint8_t> make_bank(int num_entries, size_t frames)
+{
+    SynthOptions options;
+    for (int i = 0; i < num_entries; ++i) {
+        static const WBK::Codec codecs[] = { WBK::ADPCM_1, WBK::IMA_ADPCM, WBK::ADPCM_2 };
+        options.tracks.push_back({ codecs[i % 3], (i & 1) ? 2 : 1, frames, 44100 });
+    }
+    options.threads = default_thread_count();
+    return MakeSynthBank(options);
+}
+
+WAV make_wav(const std::vector<int16_t>& pcm, int channels)
+{
+    WAV wav;
+    wav.header.numChannels = uint16_t(channels);
+    wav.header.sampleRate = 44100;
+    wav.header.bitsPerSample = 16;
+    wav.header.blockAlign = uint16_t(2 * channels);
+    wav.header.byteRate = wav.header.sampleRate * wav.header.blockAlign;
+    wav.owned = pcm;
+    wav.header.subchunk2Size = uint32_t(pcm.size() * sizeof(int16_t));
+    return wav;
+}
+
+// ------
+void bench_codecs()
+{
+    static const WBK::Codec codecs[] = { WBK::PCM, WBK::ADPCM_1, WBK::ADPCM_2, WBK::IMA_ADPCM };
+    const size_t frames = size_t(g_options.signal_seconds * 44100.0);
+
+    for (int channels : { 1, 2 }) {
+        const auto pcm = make_signal(frames, channels);
+        const uint64_t pcm_bytes = pcm.size() * sizeof(int16_t);
+        const std::string layout = channels == 1 ? "mono" : "stereo";
+
+        for (WBK::Codec codec : codecs) {
+            const WBK::codec_t* c = WBK::GetCodec(codec);
+            std::string name = c->name;
+            for (auto& ch : name) ch = char(std::tolower((unsigned char)ch));
+
+            EncodeOptions options;
+            options.threads = g_options.threads;
+            std::vector<uint8_t> encoded(WBK::GetEncodedSize(codec, frames, channels));
+
+            auto encode_with = [&](const char* variant, Adpcm1Quality quality) {
+                options.adpcm1_quality = quality;
+                run("codec/" + name + "/" + layout + "/encode" + variant, pcm_bytes, pcm.size(), nullptr, [&] {
+                    WBK::encode(pcm, channels, codec, encoded, options);
+                });
+            };
+            if (codec == WBK::ADPCM_1) {
+                encode_with("/fast", Adpcm1Quality::Fast);
+                encode_with("/normal", Adpcm1Quality::Normal);
+                encode_with("/exhaustive", Adpcm1Quality::Exhaustive);
+                run("codec/" + name + "/" + layout + "/encode/ref", pcm_bytes, pcm.size(), nullptr, [&] {
+                    EncodeAdpcm1(std::span<const int16_t>(pcm), channels);
+                });
+            }
+            else
+                encode_with("", options.adpcm1_quality);
+
+            if (codec == WBK::ADPCM_2)
+                run("codec/" + name + "/" + layout + "/encode/ref", pcm_bytes, pcm.size(), nullptr, [&] {
+                    EncodeAdpcm2(std::span<const int16_t>(pcm), channels);
+                });
+
+            // decode what was just encoded; ADPCM_1 payloads in a bank carry a 16-byte header
+            options.adpcm1_quality = Adpcm1Quality::Fast;
+            encoded.resize(WBK::encode(pcm, channels, codec, encoded, options));
+            if (codec == WBK::ADPCM_1)
+                encoded.insert(encoded.begin(), 16, 0);
+
+            const auto entry = make_entry(codec, channels, frames, encoded.size());
+            std::vector<int16_t> decoded(WBK::GetDecodedSamples(entry, encoded));
+            run("codec/" + name + "/" + layout + "/decode", decoded.size() * sizeof(int16_t), decoded.size(), nullptr, [&] {
+                WBK::decode(encoded, entry, decoded, g_options.threads);
+            });
+            if (codec == WBK::ADPCM_1)
+                run("codec/" + name + "/" + layout + "/decode/ref", decoded.size() * sizeof(int16_t), decoded.size(), nullptr, [&] {
+                    DecodeAdpcm1(encoded);
+                });
+        }
+    }
+}
+
+void bench_bank()
+{
+    const size_t frames = 44100 * 2;
+    const std::vector<uint8_t> bank = make_bank(g_options.bank_entries, frames);
+    const int n = g_options.bank_entries;
+    uint64_t samples = 0;
+    {
+        WBK wbk;
+        wbk.read(bank, false);
+        for (int i = 0; i < n; ++i)
+            samples += wbk.decoded_samples(i);
+    }
+
+    run("bank/parse", bank.size(), 0, nullptr, [&] {
+        WBK wbk;
+        wbk.read(bank, false);
+    });
+    run("bank/parse/decode_tracks", bank.size(), samples, nullptr, [&] {
+        WBK wbk;
+        wbk.decode_threads = g_options.threads;
+        wbk.read(bank, true);
+    });
+
+    // a zero-length bank file is a parse failure, not an open failure
+    const auto empty_path = std::filesystem::temp_directory_path() / "wbk_bench_empty.wbk";
+    if (FILE* empty = std::fopen(empty_path.string().c_str(), "wb"))
+        std::fclose(empty);
+    int empty_result = WBK_OK;
+    run("bank/read/empty", 0, 0, nullptr, [&] {
+        WBK wbk;
+        try {
+            empty_result = wbk.read(empty_path, false);
+        }
+        catch (const std::exception&) {
+            empty_result = -1;
+        }
+    });
+    if (selected("bank/read/empty") && empty_result != WBK_PARSE_FAILED)
+        std::fprintf(stderr, "bank/read/empty returned %d instead of WBK_PARSE_FAILED\n", empty_result);
+    std::error_code ec;
+    std::filesystem::remove(empty_path, ec);
+
+    // replacements keep each entry's codec and channel layout; setup reloads the pristine bank
+    EncodeOptions options;
+    options.threads = g_options.threads;
+    options.adpcm1_quality = Adpcm1Quality::Fast;
+    std::vector<WAV> wavs;
+    for (int i = 0; i < std::min(n, 3); ++i)
+        wavs.push_back(make_wav(make_signal(frames, (i & 1) ? 2 : 1, 1000 + i), (i & 1) ? 2 : 1));
+
+    WBK wbk;
+    auto reload = [&] { wbk.read(bank, false); };
+
+    uint64_t replaced_samples = 0;
+    for (int i = 0; i < n; ++i)
+        replaced_samples += wavs[i % wavs.size()].pcm().size();
+
+    if (n > 0) {
+        run("bank/replace/single", bank.size(), wavs[0].pcm().size(), reload, [&] {
+            wbk.replace(0, wavs[0], WBK::Keep, options);
+        });
+        run("bank/replace/sequential", bank.size(), replaced_samples, reload, [&] {
+            for (int i = 0; i < n; ++i)
+                wbk.replace(i, wavs[i % wavs.size()], WBK::Keep, options);
+        });
+        run("bank/replace/batched", bank.size(), replaced_samples, reload, [&] {
+            WBK::ReplacePlan plan(wbk, options);
+            for (int i = 0; i < n; ++i)
+                plan.add(i, wavs[i % wavs.size()]);
+            wbk.replace(plan);
+        });
+    }
+}
+
+// the same PCM as a plain WAV and with its data chunk ahead of fmt, which readers must accept too
+void bench_wav()
+{
+    const size_t frames = size_t(g_options.signal_seconds * 44100.0);
+    const auto pcm = make_signal(frames, 2);
+    const uint32_t data_size = uint32_t(pcm.size() * sizeof(int16_t));
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto plain = dir / "wbk_bench.wav";
+    const auto data_first = dir / "wbk_bench_data_first.wav";
+
+    const WAV wav = make_wav(pcm, 2);
+    std::vector<uint8_t> file(12 + 8 + data_size + 8 + 16);
+    auto put = [&, at = size_t(0)](const void* data, size_t size) mutable {
+        std::memcpy(file.data() + at, data, size);
+        at += size;
+    };
+    const uint32_t riff_size = uint32_t(file.size() - 8), fmt_size = 16;
+    put("RIFF", 4); put(&riff_size, 4); put("WAVE", 4);
+    put("data", 4); put(&data_size, 4); put(pcm.data(), data_size);
+    put("fmt ", 4); put(&fmt_size, 4); put(&wav.header.audioFormat, 16);
+
+    FILE* out = std::fopen(data_first.string().c_str(), "wb");
+    const bool written = out && std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    if (out)
+        std::fclose(out);
+    if (!written || !WAV::writeWAV(plain.string(), pcm, 44100, 2)) {
+        std::fprintf(stderr, "Failed to write the WAV files in %s\n", dir.string().c_str());
+        return;
+    }
+
+    for (const auto& [name, path] : { std::pair{ "wav/read", plain }, std::pair{ "wav/read/data_first", data_first } }) {
+        bool ok = false;
+        run(name, data_size, pcm.size(), nullptr, [&] {
+            WAV w;
+            ok = w.readWAV(path) && w.header.numChannels == 2 && w.pcm().size() == pcm.size() &&
+                 std::equal(pcm.begin(), pcm.end(), w.pcm().begin());
+        });
+        if (selected(name) && !ok)
+            std::fprintf(stderr, "%s did not read back the PCM it was written with\n", name);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(plain, ec);
+    std::filesystem::remove(data_first, ec);
+}
+
+// a million synth_* style names, resolved from text, from a compiled index and per lookup
+void bench_dictionary()
+{
+    const size_t count = 1000000;
+    std::string text;
+    for (size_t i = 0; i < count; ++i)
+        (text += SynthTrackName(i)) += '\n';
+
+    HashDictionary dict;
+    dict.load_text(text);
+    const auto path = std::filesystem::temp_directory_path() / "wbk_bench.wbkdict";
+    if (!dict.compile(path)) {
+        std::fprintf(stderr, "Failed to write %s\n", path.string().c_str());
+        return;
+    }
+    const uint64_t compiled_bytes = std::filesystem::file_size(path);
+
+    run("dict/load_text", text.size(), 0, nullptr, [&] {
+        HashDictionary d;
+        d.load_text(text);
+    });
+    run("dict/load_compiled", compiled_bytes, 0, nullptr, [&] {
+        HashDictionary d;
+        d.load(path);
+    });
+
+    std::vector<uint32_t> hashes(count);
+    for (size_t i = 0; i < count; ++i)
+        hashes[i] = HashDictionary::hash(SynthTrackName((i * 7919) % count));
+    size_t found = 0;
+    run("dict/lookup", hashes.size() * sizeof(uint32_t), 0, nullptr, [&] {
+        for (uint32_t h : hashes)
+            found += dict.find(h).size();
+    });
+    if (selected("dict/lookup") && found == 0)
+        std::fprintf(stderr, "dict/lookup resolved nothing\n");
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+// 10M candidates against a thousand hashes the template can reach; bytes are the candidate names' text
+void bench_crack()
+{
+    std::vector<uint32_t> targets;
+    for (size_t i = 0; i < 1000; ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "synth_%07zu", i * 997);
+        targets.push_back(HashDictionary::hash(name));
+    }
+
+    HashTemplate tmpl;
+    std::string error;
+    if (!tmpl.parse("{synth,sfx,vo,amb,mus,ui,foley,npc,web,hit}_{0000000..0999999}", ".", error)) {
+        std::fprintf(stderr, "crack template: %s\n", error.c_str());
+        return;
+    }
+    size_t found = 0;
+    run("crack/template", tmpl.candidates() * 11, 0, nullptr, [&] {
+        found = CrackHashes(std::span<const HashTemplate>(&tmpl, 1), targets, g_options.threads).size();
+    });
+    if (selected("crack/template") && found < targets.size())
+        std::fprintf(stderr, "crack/template found %zu of %zu names\n", found, targets.size());
+}
+
+void write_json(FILE* out)
+{
+    std::fprintf(out, "{\n  \"benchmark\": \"wbk_bench\",\n  \"version\": 1,\n");
+#if defined(__clang__)
+    std::fprintf(out, "  \"compiler\": \"clang %d.%d\",\n", __clang_major__, __clang_minor__);
+#elif defined(__GNUC__)
+    std::fprintf(out, "  \"compiler\": \"gcc %d.%d\",\n", __GNUC__, __GNUC_MINOR__);
+#elif defined(_MSC_VER)
+    std::fprintf(out, "  \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#endif
+    std::fprintf(out, "  \"threads\": %u,\n  \"signal_seconds\": %g,\n  \"bank_entries\": %d,\n  \"results\": [\n",
+                 g_options.threads, g_options.signal_seconds, g_options.bank_entries);
+    for (size_t i = 0; i < g_results.size(); ++i) {
+        const auto& r = g_results[i];
+        std::fprintf(out, "    { \"name\": \"%s\", \"iterations\": %zu, \"best_seconds\": %.9f, \"mean_seconds\": %.9f, "
+                          "\"bytes\": %llu, \"samples\": %llu, \"mb_per_s\": %.3f, \"samples_per_s\": %.1f }%s\n",
+                     r.name.c_str(), r.iterations, r.best_seconds, r.mean_seconds,
+                     (unsigned long long)r.bytes, (unsigned long long)r.samples,
+                     r.bytes / r.best_seconds / 1e6, r.samples / r.best_seconds,
+                     i + 1 < g_results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+} // namespace
+
+
+// ---------------------------
+// MAIN
+// ---------------------------
+int main(int argc, char** argv)
+{
+    const char* output = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-o") == 0 && has_value)
+            output = argv[++i];
+        else if (std::strcmp(argv[i], "-f") == 0 && has_value)
+            g_options.filter = argv[++i];
+        else if (std::strcmp(argv[i], "-t") == 0 && has_value)
+            g_options.min_seconds = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-s") == 0 && has_value)
+            g_options.signal_seconds = std::max(0.01, std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "-n") == 0 && has_value)
+            g_options.bank_entries = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-j") == 0 && has_value)
+            g_options.threads = unsigned(std::max(1, std::atoi(argv[++i])));
+        else {
+            std::printf("Usage:\n");
+            std::printf("  %s [-o <results.json>] [-f <filter>] [-t <seconds>] [-s <seconds of audio>] [-n <entries>] [-j <threads>]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    bench_codecs();
+    bench_bank();
+    bench_wav();
+    bench_dictionary();
+    bench_crack();
+
+    FILE* out = output ? std::fopen(output, "w") : stdout;
+    if (!out) {
+        std::fprintf(stderr, "Failed to open %s\n", output);
+        return WBK_WRITE_ERROR;
+    }
+    write_json(out);
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// wbk_synth.cpp - writes synthetic WBK banks for testing parse/replace/extract at scale
+// Usage:
+//   wbk_synth <out.wbk> [-n <entries>] [-b <MB>] [-c <codecs>] [-ch <channels>] [-s <min>[-<max>]] [-r <rate>]
+//             [-m <metadata>] [-g <group>] [--seed <N>] [-j <threads>] [-q <preset>]
+//
+// Notes:
+// - -n N      : number of entries (default: 10)
+// - -b MB     : instead of -n, add entries until the bank reaches MB megabytes (e.g. -b 1500)
+// - -c list   : codecs cycled over the entries, comma separated: 1=PCM, 4=ADPCM_1, 5=ADPCM_2, 7=IMA_ADPCM (default: 4,7,5)
+// - -ch list  : channel counts cycled over the entries (default: 1,2)
+// - -s sec    : track duration in seconds, or a min-max range picked per entry from the seed (default: 1-5)
+// - -r Hz     : sample rate (default: 44100)
+// - -m N      : number of metadata_t records (default: 0)
+// - -g name   : bank group string (default: none)
+// - --seed N  : seed for durations and audio (default: 1); equal options give byte-identical banks
+// - -j N      : encode tracks on N threads (default: all cores)
+// - -q preset : ADPCM_1 encoder preset: fast (default), normal or exhaustive
+// - Entry i is named synth_<i, 5 digits> and its hash is the engine hash of that name
+
+#include "wbk_synth.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<int> parse_list(const char* text)
+{
+    std::vector<int> values;
+    for (const char* p = text; *p; ) {
+        values.push_back(std::atoi(p));
+        p = std::strchr(p, ',');
+        if (!p) break;
+        ++p;
+    }
+    return values;
+}
+
+
+// ---------------------------
+// MAIN
+// ---------------------------
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argv[1][0] == '-') {
+        std::printf("Usage:\n");
+        std::printf("  %s <out.wbk> [-n <entries>] [-b <MB>] [-c <codecs>] [-ch <channels>] [-s <min>[-<max>]] [-r <rate>]\n", argv[0]);
+        std::printf("  %*s [-m <metadata>] [-g <group>] [--seed <N>] [-j <threads>] [-q <preset>]\n", int(std::strlen(argv[0])), "");
+        return -1;
+    }
+
+    size_t numEntries = 10;
+    size_t targetBytes = 0;
+    std::vector<WBK::Codec> codecs = { WBK::ADPCM_1, WBK::IMA_ADPCM, WBK::ADPCM_2 };
+    std::vector<int> channels = { 1, 2 };
+    double minSeconds = 1.0, maxSeconds = 5.0;
+    uint16_t sampleRate = 44100;
+
+    SynthOptions options;
+    options.threads = default_thread_count();
+
+    for (int i = 2; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-n") == 0 && has_value)
+            numEntries = size_t(std::max(0LL, std::atoll(argv[++i])));
+        else if (std::strcmp(argv[i], "-b") == 0 && has_value)
+            targetBytes = size_t(std::max(0LL, std::atoll(argv[++i]))) << 20;
+        else if (std::strcmp(argv[i], "-c") == 0 && has_value) {
+            codecs.clear();
+            for (int c : parse_list(argv[++i])) {
+                if (!WBK::GetCodec(WBK::Codec(c))) {
+                    std::printf("Invalid codec type specified!\n");
+                    return -1;
+                }
+                codecs.push_back(WBK::Codec(c));
+            }
+        }
+        else if (std::strcmp(argv[i], "-ch") == 0 && has_value) {
+            channels = parse_list(argv[++i]);
+            for (int ch : channels)
+                if (ch < 1 || ch > 2) {
+                    std::printf("Invalid channel count specified!\n");
+                    return -1;
+                }
+        }
+        else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            const char* range = argv[++i];
+            minSeconds = maxSeconds = std::atof(range);
+            if (const char* dash = std::strchr(range + 1, '-'))
+                maxSeconds = std::atof(dash + 1);
+            if (minSeconds <= 0 || maxSeconds < minSeconds) {
+                std::printf("Invalid duration specified!\n");
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "-r") == 0 && has_value)
+            sampleRate = uint16_t(std::clamp(std::atoi(argv[++i]), 1000, 65535));
+        else if (std::strcmp(argv[i], "-m") == 0 && has_value)
+            options.num_metadata = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-g") == 0 && has_value)
+            options.bank_group = argv[++i];
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value)
+            options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "-j") == 0 && has_value)
+            options.threads = unsigned(std::max(1, std::atoi(argv[++i])));
+        else if (std::strcmp(argv[i], "-q") == 0 && has_value) {
+            const std::string preset = argv[++i];
+            if (preset == "fast") options.adpcm1_quality = Adpcm1Quality::Fast;
+            else if (preset == "normal") options.adpcm1_quality = Adpcm1Quality::Normal;
+            else if (preset == "exhaustive") options.adpcm1_quality = Adpcm1Quality::Exhaustive;
+            else {
+                std::printf("Invalid encoder preset specified!\n");
+                return -1;
+            }
+        }
+        else {
+            std::printf("Unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    // with -b, keep adding entries until the laid-out bank reaches the target size
+    size_t bytes = 0x8000;
+    for (size_t i = 0; targetBytes ? bytes < targetBytes : i < numEntries; ++i) {
+        options.tracks.push_back(MakeSynthTrack(i, codecs, channels, minSeconds, maxSeconds, options.seed, sampleRate));
+        bytes += (SynthPayloadSize(options.tracks.back()) + 0x7FFF) & ~size_t(0x7FFF);
+    }
+
+    const int res = WriteSynthBank(argv[1], options);
+    if (res == WBK_FILE_TOO_LARGE)
+        std::printf("ERROR: Max file size, this WBK won't work in-game.\n");
+    else if (res != WBK_OK)
+        std::printf("Failed to write %s\n", argv[1]);
+    else
+        std::printf("Wrote %s: %zu entries\n", argv[1], options.tracks.size());
+    return res;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "wbk.h"
+#include "parallel.h"
+
+// ------
+// Synthetic banks: a header_t, an nslWave table, optional metadata_t records and 0x8000-aligned
+// payloads encoded from a deterministic test signal. The same options always give the same bytes.
+
+struct SynthTrack {
+    WBK::Codec codec = WBK::ADPCM_1;
+    int channels = 1;
+    size_t frames = 44100;
+    uint16_t sample_rate = 44100;
+};
+
+struct SynthOptions {
+    std::vector<SynthTrack> tracks;
+    int num_metadata = 0;
+    std::string bank_group;         // at most 15 characters, empty for none
+    uint32_t seed = 1;
+    unsigned threads = 1;           // tracks encoded in parallel
+    Adpcm1Quality adpcm1_quality = Adpcm1Quality::Fast;
+};
+
+// name the generator hashes for entry index, so dictionaries can be built for synthetic banks
+inline std::string SynthTrackName(size_t index)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "synth_%05zu", index);
+    return name;
+}
+
+// Track index of a bank whose codecs and channel layouts cycle through the given lists,
+// with a duration picked from [min_seconds, max_seconds] by the seed
+inline SynthTrack MakeSynthTrack(size_t index, std::span<const WBK::Codec> codecs, std::span<const int> channels,
+                                 double min_seconds, double max_seconds, uint32_t seed, uint16_t sample_rate = 44100)
+{
+    uint32_t rng = seed * 2654435761u + uint32_t(index) * 40503u + 1u;
+    rng ^= rng >> 15; rng *= 2246822519u; rng ^= rng >> 13;
+    const double t = double(rng & 0xFFFFFF) / double(0xFFFFFF);
+
+    SynthTrack track;
+    track.codec = codecs.empty() ? WBK::ADPCM_1 : codecs[index % codecs.size()];
+    track.channels = channels.empty() ? 1 : channels[index % channels.size()];
+    track.sample_rate = sample_rate;
+    track.frames = std::max<size_t>(1, size_t((min_seconds + (max_seconds - min_seconds) * t) * sample_rate));
+    return track;
+}
+
+// test signal: two partials, a sweep and a little noise, different per channel and per seed
+inline void SynthSignal(std::span<int16_t> out, int channels, uint16_t sample_rate, uint32_t seed)
+{
+    const double two_pi = 6.283185307179586;
+    const double base = 110.0 + (seed % 24) * 20.0;
+    uint32_t rng = seed | 1u;
+    const size_t frames = out.size() / std::max(channels, 1);
+    for (size_t i = 0; i < frames; ++i) {
+        const double t = double(i) / sample_rate;
+        for (int ch = 0; ch < channels; ++ch) {
+            rng = rng * 1664525u + 1013904223u;
+            const double noise = double(int32_t(rng >> 16) - 32768) / 32768.0;
+            const double v = 9000.0 * std::sin(two_pi * (base + 110.0 * ch) * t)
+                           + 4000.0 * std::sin(two_pi * (1000.0 + 800.0 * std::fmod(t, 4.0)) * t)
+                           + 600.0 * noise;
+            out[i * channels + ch] = int16_t(std::clamp(v, -32768.0, 32767.0));
+        }
+    }
+}
+
+// ADPCM_1 payloads in a bank start with a 16-byte header that the decoder skips
+inline size_t SynthPayloadSize(const SynthTrack& track)
+{
+    const size_t size = WBK::GetEncodedSize(track.codec, track.frames, track.channels);
+    return track.codec == WBK::ADPCM_1 && size ? size + 16 : size;
+}
+
+inline std::vector<uint8_t> SynthPayload(const SynthTrack& track, uint32_t seed, Adpcm1Quality quality)
+{
+    std::vector<int16_t> pcm(track.frames * track.channels);
+    SynthSignal(pcm, track.channels, track.sample_rate, seed);
+
+    std::vector<uint8_t> payload(SynthPayloadSize(track));
+    const size_t header = track.codec == WBK::ADPCM_1 && !payload.empty() ? 16 : 0;
+    EncodeOptions options;
+    options.adpcm1_quality = quality;
+    payload.resize(header + WBK::encode(pcm, track.channels, track.codec, std::span<uint8_t>(payload).subspan(header), options));
+    return payload;
+}
+
+// Generates the bank and hands it to sink(std::span<const uint8_t>) front to back, so it never has
+// to be held in memory as a whole. Returns WBK_OK or WBK_FILE_TOO_LARGE.
+template <typename Sink>
+int BuildSynthBank(const SynthOptions& options, Sink&& sink)
+{
+    auto align = [](size_t v) { return (v + 0x7FFF) & ~size_t(0x7FFF); };
+
+    // layout: header, entry table, metadata, bank group, then the payloads
+    const size_t count = options.tracks.size();
+    const size_t metadata_offs = sizeof(WBK::header_t) + sizeof(WBK::nslWave) * count;
+    const size_t group_offs = metadata_offs + sizeof(WBK::metadata_t) * size_t(std::max(options.num_metadata, 0));
+    const size_t data_start = align(group_offs + 16);
+
+    std::vector<WBK::nslWave> entries(count);
+    size_t total = data_start;
+    for (size_t i = 0; i < count; ++i) {
+        const SynthTrack& track = options.tracks[i];
+        WBK::nslWave& entry = entries[i];
+        entry = {};
+        entry.hash = int(string_hash::to_hash(SynthTrackName(i).c_str()));
+        entry.codec = track.codec;
+        WBK::SetNumChannels(entry, track.channels);
+        entry.num_samples = int(track.frames);
+        entry.num_bytes = unsigned(SynthPayloadSize(track));
+        entry.samples_per_second = track.sample_rate;
+        entry.compressed_data_offs = int(total);
+        total = align(total + entry.num_bytes);
+        if (total >= INT_MAX)
+            return WBK_FILE_TOO_LARGE;
+    }
+
+    std::vector<uint8_t> head(data_start);
+    WBK::header_t header{};
+    std::memcpy(header.magic, "WBK", 3);
+    std::strncpy(header.name, "synthetic", sizeof(header.name) - 1);
+    header.size = int(total);
+    header.sample_data_offs = int(data_start);
+    header.total_bytes = int(total);
+    header.num_entries = int(count);
+    if (options.num_metadata > 0) {
+        header.metadata_offs = int(metadata_offs);
+        header.entry_desc_offs = int(group_offs);
+    }
+    std::memcpy(head.data(), &header, sizeof(header));
+    std::memcpy(head.data() + sizeof(header), entries.data(), sizeof(WBK::nslWave) * count);
+    for (int m = 0; m < options.num_metadata; ++m) {
+        WBK::metadata_t meta{};
+        meta.codec = options.tracks.empty() ? WBK::ADPCM_1 : options.tracks[m % count].codec;
+        meta.unk_vals = uint32_t(m);
+        for (int k = 0; k < 6; ++k)
+            meta.unk_fvals[k] = float(m) + k * 0.25f;
+        std::memcpy(head.data() + metadata_offs + sizeof(meta) * m, &meta, sizeof(meta));
+    }
+    std::memcpy(head.data() + group_offs, options.bank_group.data(), std::min<size_t>(options.bank_group.size(), 15));
+    sink(std::span<const uint8_t>(head));
+
+    // encode a window of tracks at a time on the workers, then hand them over in order
+    const unsigned threads = std::max(options.threads, 1u);
+    const size_t window = size_t(threads) * 4;
+    std::vector<std::vector<uint8_t>> payloads(window);
+    const std::vector<uint8_t> padding(0x8000, 0);
+    for (size_t first = 0; first < count; first += window) {
+        const size_t n = std::min(window, count - first);
+        parallel_for(n, threads, [&](size_t k) {
+            payloads[k] = SynthPayload(options.tracks[first + k], options.seed + uint32_t(first + k), options.adpcm1_quality);
+        });
+        for (size_t k = 0; k < n; ++k) {
+            const size_t size = payloads[k].size();
+            sink(std::span<const uint8_t>(payloads[k]));
+            sink(std::span<const uint8_t>(padding).first(align(size) - size));
+            payloads[k] = {};
+        }
+    }
+    return WBK_OK;
+}
+
+inline std::vector<uint8_t> MakeSynthBank(const SynthOptions& options)
+{
+    std::vector<uint8_t> bank;
+    BuildSynthBank(options, [&](std::span<const uint8_t> bytes) { bank.insert(bank.end(), bytes.begin(), bytes.end()); });
+    return bank;
+}
+
+inline int WriteSynthBank(const std::filesystem::path& path, const SynthOptions& options)
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs.good())
+        return WBK_WRITE_ERROR;
+    const int res = BuildSynthBank(options, [&](std::span<const uint8_t> bytes) {
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    });
+    if (res != WBK_OK)
+        return res;
+    return ofs.good() ? WBK_OK : WBK_WRITE_ERROR;
+}
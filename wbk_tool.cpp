@@ -1,25 +1,66 @@
 // main.cpp  WBK extract/reimport with optional name resolution via dictionary
 // Usage:
-//   Extract:  tool -e <input.wbk> <out_dir> [-h] [-n] [-d <dict.txt>]
-//   Replace:  tool -r <input.wbk> <index|0xHASH|name|folder> <replacement.wav(if single)> [-h] [-n] [-d <dict.txt>] [-c <codec>]
+//   Extract:  tool -e <input.wbk> <out_dir> [-h] [-n] [-d <dict.txt>] [-j <threads>] [-m <MB>]
+//   Batch:    tool -be <folder|banks.txt> <out_root> [extract options]
+//             tool -br <folder|banks.txt> <replacement_root> [replace options, no --snr]
+//   Compile:  tool -D <dict.txt> <dict.wbkdict>
+//   Catalog:  tool -catalog <folder|banks.txt> <catalog.wbkcat> [-j <threads>]
+//             tool -find <catalog.wbkcat> <0xHASH|name> [more ...] [-d <dict.txt>]
+//   Crack:    tool -crack <template|@templates.txt> <input.wbk> [more.wbk ...] [-d <dict.txt>] [-j <threads>]
+//   Replace:  tool -r <input.wbk> <index|0xHASH|name|folder> <replacement.wav(if single)> [-h] [-n] [-d <dict.txt>] [-c <codec>] [-j <threads>] [-q <preset>] [--snr]
 //
 // Notes:
 // - -h      : treat the third argument (single replace) as a raw 32-bit hash, or make extracted filenames 0xHASH.wav
 // - -n      : resolve names using dictionary; for single replace, the 3rd arg is a *name* that will be hashed
-// - -d file : path to string_hash_dictionary.txt (one name per line is fine; hashes auto-computed)
+// - -d file : path to string_hash_dictionary.txt (one name per line is fine; hashes auto-computed), or a
+//             dictionary compiled with -D, which is mapped and used without parsing
+//             (default with -n: string_hash_dictionary.txt in the current directory, if present)
+// - -j N    : number of worker threads for extraction and folder replace (default: all cores)
+// - -m MB   : decode chunk size while extracting; each worker streams its tracks through MB / threads (default: 256)
+// - -q      : ADPCM_1 encoder preset when replacing: fast | normal | exhaustive (default)
+// - -j N    : for a single ADPCM_1/ADPCM_2 replace, encodes the track on N threads
+// - --snr   : for a single ADPCM_1 replace, report the SNR against the serial encoder
+// - --keep-offsets : replacements that fit their existing 0x8000-aligned slot are written over it, larger ones
+//                    move to the end of the bank; nothing else is shifted
+// - --in-place : implies --keep-offsets and patches only the changed bytes into <input> instead of writing <input>.new.wbk
+// - --dedupe : entries whose payloads are byte-identical share one copy; repacks the whole bank, or with
+//              --keep-offsets/--in-place only points replacements at an equal payload already in the bank
+// - --stats : print time, bytes and samples per phase and codec, and the peak RSS, when done
+// - --trace file : write every timed phase (per track, per thread) as a Chrome trace (chrome://tracing, Perfetto)
+// - -be/-br : run extraction or folder replace over every .wbk under a folder (recursively) or listed in a manifest
+//             (one path per line, relative to the manifest). Bank <rel>/<name>.wbk is extracted to <out_root>/<rel>/<name>/
+//             and replaced from <replacement_root>/<rel>/<name>/ when that folder exists. The dictionary is loaded once,
+//             and the tracks of all banks share one job list on -j workers, longest first
+// - -catalog : records every entry of every bank (hash, bank, index, codec, channels, rate, num_samples, payload
+//              offset/size and a payload content hash) in one index file. Re-running it only rereads banks whose
+//              size or modification time changed, and drops banks that are gone
+// - -find : answers which banks hold a hash or name from the catalog alone, without opening any bank
+// - -crack : tries every name the template expands to against the hashes that no dictionary name resolves in the
+//            given banks, and appends hits to the -d dictionary (default string_hash_dictionary.txt) as 0xHASH<tab>name.
+//            Templates are literal text with {01..99} ranges, {a,b,c} alternatives and {@words.txt} word lists;
+//            @file reads one template per line
 // - With -n, extraction names are <resolved>.wav when possible; otherwise fall back to 0xHASH.wav
 // - Folder replace tries (in order): <i>.wav, <resolved>.wav (if -n and found), 0xHASH.wav
 // - Writes <input>.new.wbk when changes were made
 
 #include "wbk.h"
+#include "hash_dictionary.h"
+#include "hash_crack.h"
+#include "catalog.h"
+#include "parallel.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <filesystem>
+#include <format>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -29,24 +70,8 @@
 namespace fs = std::filesystem;
 
 // ---------------------------
-// Small helpers (hash, trim, lower)
+// Small helpers (trim, lower)
 // ---------------------------
-static inline bool is_alpha(unsigned char c) {
-    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
-}
-static inline unsigned char to_lower_uc(unsigned char c) {
-    constexpr auto delta = 'a' - 'A';
-    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + delta) : c;
-}
-// Engine string-hash (case-insensitive letters, multiplier 33)
-static inline uint32_t engine_to_hash(std::string_view s) {
-    uint32_t res = 0;
-    for (unsigned char c : s) {
-        int cl = is_alpha(c) ? to_lower_uc(c) : c;
-        res = (uint32_t)(cl + 33u * res);
-    }
-    return res;
-}
 static inline std::string trim_copy(std::string s) {
     auto issp = [](unsigned char c) { return std::isspace(c) != 0; };
     size_t a = 0, b = s.size();
@@ -63,62 +88,520 @@ static inline std::string to_lower_copy(std::string s) {
 }
 
 // ---------------------------
-// Dictionary (name <-> hash)
+// Dictionary (hash -> name), text or compiled, see hash_dictionary.h
 // ---------------------------
-static std::unordered_map<uint32_t, std::string> g_hash_to_name;
-static std::unordered_map<std::string, uint32_t> g_name_to_hash; // lowercased key
+static HashDictionary g_dictionary;
 
-// Accepts flexible formats per line:
-//   - raw name (e.g., "sfx/ambience/wind_light")
-//   - "0x12345678 some/name" (hash ignored; we recompute from the name to be consistent)
-//   - comments starting with '#' or '//'
 static bool load_dictionary(const fs::path& dict_path) {
-    std::ifstream f(dict_path);
-    if (!f) {
+    if (!g_dictionary.load(dict_path)) {
         std::fprintf(stderr, "Failed to open dictionary: %s\n", dict_path.string().c_str());
         return false;
     }
-    size_t added = 0;
-    std::string line;
-    while (std::getline(f, line)) {
-        line = trim_copy(line);
-        if (line.empty()) continue;
-        if (line.rfind("#", 0) == 0 || line.rfind("//", 0) == 0) continue;
-
-        std::string name = line;
-        // If it begins with 0x..., split and take the rest as name (for human notes files)
-        if (line.size() > 2 && line[0] == '0' && (line[1] == 'x' || line[1] == 'X')) {
-            // find first space after the hex
-            auto sp = line.find_first_of(" \t");
-            if (sp != std::string::npos) {
-                name = trim_copy(line.substr(sp + 1));
-                if (name.empty()) continue;
+    std::fprintf(stderr, "Loaded %zu dictionary entries from %s\n", g_dictionary.size(), dict_path.string().c_str());
+    return true;
+}
+
+// names always hash with the engine hash, whether or not the dictionary knows them
+static uint32_t lookup_hash_by_name(const std::string& name) {
+    return HashDictionary::hash(trim_copy(name));
+}
+
+// ---------------------------
+// Per-track jobs, shared by the single-bank modes and -be/-br
+// ---------------------------
+struct track_options_t {
+    bool hashSearch = false;
+    bool resolveHashes = false;
+    WBK::Codec codec = WBK::Keep;
+    EncodeOptions encodeOptions;        // for one track; the tracks themselves are spread over the workers
+    size_t chunkSamples = 4096;         // decoded samples each extraction worker buffers
+};
+
+// Helper that decides filename for a given entry index
+static std::string track_filename(const WBK& wbk, int i, const track_options_t& options) {
+    const auto& e = wbk.entries[i];
+    if (options.hashSearch) {
+        if (options.resolveHashes) {
+            auto hname = g_dictionary.find(e.hash);
+            if (!hname.empty())
+                return std::format("{}.wav", hname);
+        }
+        return std::format("0x{:08x}.wav", e.hash);
+    }
+    return std::format("{}.wav", i);
+}
+
+// streams one entry through a fixed chunk into <dir>/<track_filename>, so the decoded PCM in flight stays bounded
+static bool extract_track(const WBK& wbk, int i, const fs::path& dir, const track_options_t& options) {
+    Trace::Scope scope(g_trace, "extract_track", nullptr, i);
+    const auto& entry = wbk.entries[i];
+    std::vector<int16_t> chunk(std::min(options.chunkSamples, wbk.decoded_samples(i)));
+
+    fs::path out = dir / track_filename(wbk, i, options);
+    TrackDecoder decoder = wbk.open_track(i);
+    WavWriter writer;
+    bool ok = writer.open(out, entry.samples_per_second, decoder.channels());
+    while (ok && !chunk.empty()) {
+        const size_t n = decoder.read(chunk);
+        if (!n) break;
+        ok = writer.write(std::span<const int16_t>(chunk.data(), n));
+    }
+    if (!writer.close() || !ok) {
+        std::fprintf(stderr, "Failed to write %s\n", out.string().c_str());
+        return false;
+    }
+    return true;
+}
+
+struct staged_track_t {
+    fs::path wav_file;
+    std::vector<std::string> errors;
+    bool done = false;
+};
+
+// Reads and encodes the first replacement found for entry i in dir and stages it in plan. Encoding
+// runs outside plan_lock; the plan is keyed by index, so the order tracks finish in does not matter.
+static staged_track_t stage_replacement(WBK::ReplacePlan& plan, std::mutex& plan_lock, const WBK& wbk, int i,
+                                        const fs::path& dir, const track_options_t& options) {
+    Trace::Scope scope(g_trace, "replace_track", nullptr, i);
+    const auto& e = wbk.entries[i];
+    staged_track_t result;
+
+    // Candidate filenames to look up
+    std::vector<fs::path> candidates;
+    candidates.emplace_back(dir / std::format("{}.wav", i)); // index.wav
+
+    if (options.hashSearch) {
+        if (options.resolveHashes) {
+            auto nice = g_dictionary.find(e.hash);
+            if (!nice.empty())
+                candidates.emplace_back(dir / std::format("{}.wav", nice)); // name.wav
+        }
+        candidates.emplace_back(dir / std::format("0x{:08x}.wav", e.hash)); // 0xHASH.wav
+    }
+
+    for (const auto& wav_file : candidates) {
+        if (!fs::exists(wav_file)) continue;
+
+        WAV wav;
+        if (!wav.readWAV(wav_file.string())) {
+            result.errors.push_back(std::format("Failed to parse WAV: {}", wav_file.string()));
+            continue;
+        }
+
+        const WBK::Codec target = plan.target_codec(i, options.codec);
+        std::vector<uint8_t> encoded = WBK::encode(wav, target, options.encodeOptions);
+
+        std::lock_guard guard(plan_lock);
+        if (plan.add(i, wav, target, std::move(encoded)) == WBK_OK) {
+            result.wav_file = wav_file;
+            result.done = true;
+            break;
+        }
+        else {
+            result.errors.push_back(std::format("Replace failed for {}", wav_file.string()));
+        }
+    }
+    return result;
+}
+
+struct bank_options_t {
+    WBK::Layout layout = WBK::Layout::Compact;
+    bool dedupe = false;
+    bool inPlace = false;
+};
+
+// writes a replaced bank to <input>.new.wbk, or patches it into <input> with --in-place
+static int write_replaced_bank(WBK& wbk, const fs::path& input, const bank_options_t& options) {
+    if (options.inPlace) {
+        if (wbk.write_in_place(input) != WBK_OK) {
+            std::fprintf(stderr, "In-place write to %s failed\n", input.string().c_str());
+            return WBK_WRITE_ERROR;
+        }
+        std::printf("Patched %s in place\n", input.string().c_str());
+        return WBK_OK;
+    }
+    fs::path out = fs::path(input).replace_extension(".new.wbk");
+    const int res = wbk.write(out);
+    if (res == WBK_FILE_TOO_LARGE)
+        std::fprintf(stderr, "ERROR: Max file size, %s won't work in-game.\n", out.string().c_str());
+    else if (res != WBK_OK)
+        std::fprintf(stderr, "Failed to write %s\n", out.string().c_str());
+    else
+        std::printf("Written to %s\n", out.string().c_str());
+    return res;
+}
+
+// ---------------------------
+// Batch mode (-be/-br): many banks, one pool of track jobs
+// ---------------------------
+struct batch_bank_t {
+    fs::path path;
+    fs::path dir;       // output folder (-be) or replacement folder (-br) for this bank
+    std::unique_ptr<WBK> wbk;
+    std::unique_ptr<WBK::ReplacePlan> plan;
+    std::mutex plan_lock;
+    std::vector<staged_track_t> results;
+};
+
+// Banks under a folder (recursively, skipping .new.wbk outputs) or listed in a manifest, one path per
+// line relative to the manifest; each comes with its path relative to the root, minus the extension
+static std::vector<std::pair<fs::path, fs::path>> list_batch_banks(const fs::path& input) {
+    std::vector<std::pair<fs::path, fs::path>> banks;
+    auto is_bank = [](const fs::path& p) {
+        const std::string name = to_lower_copy(p.filename().string());
+        return name.ends_with(".wbk") && !name.ends_with(".new.wbk");
+    };
+
+    std::error_code ec;
+    if (fs::is_directory(input, ec)) {
+        for (auto it = fs::recursive_directory_iterator(input, fs::directory_options::skip_permission_denied, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_regular_file(ec) && is_bank(it->path()))
+                banks.emplace_back(it->path(), fs::relative(it->path(), input, ec).replace_extension());
+        }
+    }
+    else {
+        std::ifstream in(input);
+        for (std::string line; std::getline(in, line); ) {
+            line = trim_copy(line);
+            if (line.empty() || line[0] == '#') continue;
+            fs::path bank = line;
+            fs::path rel = bank.is_relative() ? bank : bank.filename();
+            if (bank.is_relative())
+                bank = input.parent_path() / bank;
+            banks.emplace_back(bank, rel.replace_extension());
+        }
+    }
+    std::sort(banks.begin(), banks.end());
+    return banks;
+}
+
+// Extracts (-be) every bank to <root>/<relative path>/, or replaces (-br) every bank that has a
+// <root>/<relative path>/ folder of WAVs. All tracks of all banks go through one job list.
+static int run_batch(bool extract, const fs::path& input, const fs::path& root, const track_options_t& trackOptions,
+                     const bank_options_t& bankOptions, unsigned numThreads) {
+    if (!fs::exists(input)) {
+        std::fprintf(stderr, "Batch input %s not found\n", input.string().c_str());
+        return -1;
+    }
+    const auto listed = list_batch_banks(input);
+    if (listed.empty()) {
+        std::printf("No banks found in %s\n", input.string().c_str());
+        return -1;
+    }
+
+    // parse all banks first; they are mapped, so this only reads headers and entry tables.
+    // a bank that cannot be read is reported and left out, the others still go through
+    std::vector<batch_bank_t> banks(listed.size());
+    std::atomic<size_t> failedBanks = 0;
+    parallel_for(banks.size(), numThreads, [&](size_t b) {
+        auto& bank = banks[b];
+        bank.path = listed[b].first;
+        bank.dir = root / listed[b].second;
+        bank.wbk = std::make_unique<WBK>();
+        try {
+            if (bank.wbk->read(bank.path, /*DecodeTracks=*/false) != WBK_OK) {
+                std::fprintf(stderr, "Failed to parse %s\n", bank.path.string().c_str());
+                bank.wbk.reset();
             }
-            else {
-                // only a hex? skip; we need a name
+        }
+        catch (const std::exception& e) {
+            std::fprintf(stderr, "Failed to read %s: %s\n", bank.path.string().c_str(), e.what());
+            bank.wbk.reset();
+        }
+        if (!bank.wbk)
+            failedBanks++;
+    });
+
+    // one job per track across all banks, longest first, so a big music bank is started early
+    // instead of running alone on one core after the small SFX banks are done
+    struct job_t { uint32_t bank; int track; size_t samples; };
+    std::vector<job_t> jobs;
+    for (size_t b = 0; b < banks.size(); ++b) {
+        auto& bank = banks[b];
+        if (!bank.wbk)
+            continue;
+        std::error_code ec;
+        if (extract) {
+            fs::create_directories(bank.dir, ec);
+        }
+        else {
+            if (!fs::is_directory(bank.dir, ec))
+                continue;   // nothing to replace in this one
+            bank.plan = std::make_unique<WBK::ReplacePlan>(*bank.wbk, trackOptions.encodeOptions);
+            bank.plan->layout = bankOptions.layout;
+            bank.plan->dedupe = bankOptions.dedupe;
+            bank.results.resize(bank.wbk->entries.size());
+        }
+        for (int i = 0; i < (int)bank.wbk->entries.size(); ++i)
+            jobs.push_back({ uint32_t(b), i, bank.wbk->decoded_samples(i) });
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [](const job_t& a, const job_t& b) { return a.samples > b.samples; });
+
+    std::atomic<size_t> failed = 0;
+    parallel_for(jobs.size(), numThreads, [&](size_t j) {
+        auto& bank = banks[jobs[j].bank];
+        const int i = jobs[j].track;
+        if (extract) {
+            if (!extract_track(*bank.wbk, i, bank.dir, trackOptions))
+                failed++;
+        }
+        else {
+            bank.results[i] = stage_replacement(*bank.plan, bank.plan_lock, *bank.wbk, i, bank.dir, trackOptions);
+        }
+    });
+
+    if (extract) {
+        std::printf("Extracted %zu tracks from %zu banks to %s\n", jobs.size() - failed, banks.size() - failedBanks,
+                    root.string().c_str());
+        if (failed > 0)
+            std::fprintf(stderr, "%zu tracks failed\n", size_t(failed));
+        if (failedBanks > 0)
+            std::fprintf(stderr, "%zu banks could not be read\n", size_t(failedBanks));
+        // 1 on success like -e; WBK_PARSE_FAILED is also 1, so unreadable banks report -1
+        return failedBanks > 0 ? -1 : failed > 0 ? WBK_WRITE_ERROR : 1;
+    }
+
+    // lay out and write each bank once all of its tracks are staged, freeing it right after
+    int written = 0, res = WBK_OK;
+    for (auto& bank : banks) {
+        if (!bank.plan)
+            continue;
+        int successes = 0;
+        for (const auto& result : bank.results) {
+            for (const auto& error : result.errors)
+                std::fprintf(stderr, "%s\n", error.c_str());
+            successes += result.done;
+        }
+        std::printf("%s: replaced %d/%zu entries\n", bank.path.string().c_str(), successes, bank.wbk->entries.size());
+
+        WBK::dedupe_stats_t dedupeStats;
+        if (bank.wbk->replace(*bank.plan, &dedupeStats) != WBK_OK) {
+            std::fprintf(stderr, "Replace failed for %s\n", bank.path.string().c_str());
+            res = WBK_WRITE_ERROR;
+        }
+        else if (!bank.plan->empty() || dedupeStats.shared_entries > 0) {
+            if (bankOptions.dedupe)
+                std::printf("Deduplicated %d entries, saved %zu bytes\n", dedupeStats.shared_entries, dedupeStats.bytes_saved);
+            if (const int w = write_replaced_bank(*bank.wbk, bank.path, bankOptions); w != WBK_OK)
+                res = w;
+            else
+                written++;
+        }
+        bank.plan.reset();
+        bank.wbk.reset();
+    }
+    if (failedBanks > 0) {
+        std::fprintf(stderr, "%zu banks could not be read\n", size_t(failedBanks));
+        if (res == WBK_OK)
+            res = -1;   // not WBK_PARSE_FAILED, which is the same 1 a written bank returns
+    }
+    if (res != WBK_OK)
+        return res;
+    return written > 0 ? 1 : 0;
+}
+
+// ---------------------------
+// Catalog (-catalog, -find), see catalog.h
+// ---------------------------
+static int update_catalog(const fs::path& input, const fs::path& catalogPath, unsigned numThreads) {
+    if (!fs::exists(input)) {
+        std::fprintf(stderr, "Catalog input %s not found\n", input.string().c_str());
+        return -1;
+    }
+    std::vector<fs::path> paths;
+    for (auto& [bank, rel] : list_batch_banks(input))
+        paths.push_back(bank);
+
+    BankCatalog catalog;
+    if (fs::exists(catalogPath) && !catalog.load(catalogPath))
+        std::fprintf(stderr, "Warning: %s is not a catalog; rebuilding it\n", catalogPath.string().c_str());
+
+    BankCatalog::update_stats_t stats;
+    catalog.update(paths, numThreads, stats);
+    for (const auto& error : stats.errors)
+        std::fprintf(stderr, "%s\n", error.c_str());
+    if (!catalog.save(catalogPath)) {
+        std::fprintf(stderr, "Failed to write %s\n", catalogPath.string().c_str());
+        return WBK_WRITE_ERROR;
+    }
+    std::printf("Catalogued %zu banks (%zu scanned, %zu unchanged, %zu removed), %zu entries in %s\n",
+        catalog.num_banks(), stats.scanned, stats.reused, stats.removed, catalog.all_entries().size(),
+        catalogPath.string().c_str());
+    if (!stats.errors.empty()) {
+        std::fprintf(stderr, "%zu banks could not be read and are not in the catalog\n", stats.errors.size());
+        return WBK_PARSE_FAILED;
+    }
+    return 0;
+}
+
+// every catalogued entry for each 0xHASH, decimal hash or name in argv[3...]
+static int find_in_catalog(int argc, char** argv) {
+    BankCatalog catalog;
+    {
+        Trace::Scope scope(g_trace, "catalog_load");
+        if (!catalog.load(argv[2])) {
+            std::fprintf(stderr, "Failed to load catalog %s\n", argv[2]);
+            return WBK_PARSE_FAILED;
+        }
+    }
+
+    int found = 0, queries = 0;
+    for (int i = 3; i < argc && argv[i][0] != '-'; ++i, ++queries) {
+        std::string query = argv[i];
+        uint32_t hash = 0;
+        if (query.rfind("0x", 0) == 0 || query.rfind("0X", 0) == 0)
+            hash = (uint32_t)std::strtoul(query.c_str() + 2, nullptr, 16);
+        else if (!query.empty() && std::all_of(query.begin(), query.end(), [](unsigned char c) { return std::isdigit(c) != 0; }))
+            hash = (uint32_t)std::strtoul(query.c_str(), nullptr, 10);
+        else
+            hash = lookup_hash_by_name(query);
+
+        std::span<const BankCatalog::entry_t> matches;
+        {
+            Trace::Scope scope(g_trace, "catalog_find");
+            matches = catalog.find(hash);
+        }
+        if (matches.empty()) {
+            std::printf("0x%08x  not found\n", hash);
+            continue;
+        }
+        const auto name = g_dictionary.find(hash);
+        for (const auto& e : matches) {
+            const auto* c = WBK::GetCodec(WBK::Codec(e.codec));
+            std::printf("0x%08x  %s  %s #%u  %s %uch %u Hz  %u samples  payload 0x%x+%u  content %016llx\n",
+                e.hash, name.empty() ? "-" : std::string(name).c_str(), std::string(catalog.bank_path(e.bank)).c_str(),
+                e.index, c ? c->name : "?", unsigned(e.channels), unsigned(e.sample_rate), e.num_samples,
+                e.payload_offs, e.payload_size, (unsigned long long)e.content_hash);
+            ++found;
+        }
+    }
+    if (queries == 0) {
+        std::fprintf(stderr, "Missing <0xHASH|name> for -find.\n");
+        return -1;
+    }
+    return found ? 0 : WBK_HASH_NOT_FOUND;
+}
+
+// ---------------------------
+// Hash cracking (-crack), see hash_crack.h
+// ---------------------------
+static int crack_hashes(int argc, char** argv, fs::path dictPath, unsigned numThreads) {
+    if (dictPath.empty())
+        dictPath = "string_hash_dictionary.txt";
+    if (fs::exists(dictPath) && !load_dictionary(dictPath))
+        return -1;
+
+    // targets: entry hashes of every bank that the dictionary does not resolve yet;
+    // banks that cannot be read are reported and skipped
+    std::vector<uint32_t> targets;
+    size_t numBanks = 0, failedBanks = 0;
+    for (int i = 3; i < argc && argv[i][0] != '-'; ++i, ++numBanks) {
+        WBK bank;
+        try {
+            if (bank.read(argv[i], /*DecodeTracks=*/false) != WBK_OK) {
+                std::fprintf(stderr, "Failed to parse %s\n", argv[i]);
+                failedBanks++;
                 continue;
             }
         }
-        // normalize to lower for map key (engine hash ignores case for letters)
-        std::string name_norm = to_lower_copy(name);
-        uint32_t h = engine_to_hash(name_norm);
-        // prefer first seen mapping; skip duplicates unless we want to override
-        if (!g_hash_to_name.count(h)) g_hash_to_name[h] = name; // store the original-casing name
-        if (!g_name_to_hash.count(name_norm)) g_name_to_hash[name_norm] = h;
-        ++added;
+        catch (const std::exception& e) {
+            std::fprintf(stderr, "Failed to read %s: %s\n", argv[i], e.what());
+            failedBanks++;
+            continue;
+        }
+        for (const auto& e : bank.entries)
+            if (!g_dictionary.contains(uint32_t(e.hash)))
+                targets.push_back(uint32_t(e.hash));
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    if (numBanks == 0) {
+        std::fprintf(stderr, "Missing <.wbk> for -crack.\n");
+        return -1;
+    }
+    if (failedBanks == numBanks)
+        return WBK_PARSE_FAILED;
+
+    std::vector<std::string> sources;
+    fs::path baseDir = ".";
+    if (argv[2][0] == '@') {
+        baseDir = fs::path(argv[2] + 1).parent_path();
+        std::ifstream in(argv[2] + 1);
+        if (!in) {
+            std::fprintf(stderr, "Failed to open %s\n", argv[2] + 1);
+            return -1;
+        }
+        for (std::string line; std::getline(in, line); ) {
+            line = trim_copy(line);
+            if (!line.empty() && line[0] != '#')
+                sources.push_back(line);
+        }
+    }
+    else {
+        sources.push_back(argv[2]);
     }
-    std::fprintf(stderr, "Loaded %zu dictionary entries from %s\n", added, dict_path.string().c_str());
-    return true;
-}
 
+    std::vector<HashTemplate> templates(sources.size());
+    uint64_t candidates = 0;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        std::string error;
+        if (!templates[i].parse(sources[i], baseDir, error)) {
+            std::fprintf(stderr, "Bad template \"%s\": %s\n", sources[i].c_str(), error.c_str());
+            return -1;
+        }
+        candidates = std::min<uint64_t>(UINT64_MAX - candidates, templates[i].candidates()) + candidates;
+    }
 
+    std::printf("Trying %llu names against %zu unresolved hashes\n", (unsigned long long)candidates, targets.size());
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<CrackHit> hits;
+    {
+        Trace::Scope scope(g_trace, "crack");
+        hits = CrackHashes(templates, targets, numThreads);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // first hit per hash goes to the dictionary; later ones are collisions and only reported
+    std::vector<const CrackHit*> fresh;
+    std::vector<uint32_t> resolved;
+    for (const auto& hit : hits) {
+        const bool first = std::find(resolved.begin(), resolved.end(), hit.hash) == resolved.end();
+        std::printf("0x%08x  %s%s\n", hit.hash, hit.name.c_str(), first ? "" : "  (collision)");
+        if (first) {
+            resolved.push_back(hit.hash);
+            fresh.push_back(&hit);
+        }
+    }
+    std::printf("Resolved %zu/%zu hashes in %.2f s (%.1f M names/s)\n", resolved.size(), targets.size(),
+        seconds, seconds > 0 ? candidates / seconds / 1e6 : 0.0);
+
+    if (fresh.empty())
+        return 0;
+    if (HashDictionary::is_compiled(dictPath)) {
+        std::fprintf(stderr, "%s is a compiled dictionary; add the names above to its text source and rebuild it with -D\n",
+            dictPath.string().c_str());
+        return 0;
+    }
 
-static std::optional<uint32_t> lookup_hash_by_name(std::string name) {
-    std::string key = to_lower_copy(trim_copy(name));
-    auto it = g_name_to_hash.find(key);
-    if (it != g_name_to_hash.end()) return it->second;
-    // Not in dict? Still allow hashing the provided string directly.
-    return engine_to_hash(key);
+    // keep the file line-based even if its last line has no newline
+    bool needsNewline = false;
+    if (std::ifstream in(dictPath, std::ios::binary | std::ios::ate); in && in.tellg() > 0) {
+        in.seekg(-1, std::ios::end);
+        needsNewline = in.get() != '\n';
+    }
+    std::ofstream out(dictPath, std::ios::binary | std::ios::app);
+    if (needsNewline)
+        out << '\n';
+    for (const CrackHit* hit : fresh)
+        out << std::format("0x{:08x}\t{}\n", hit->hash, hit->name);
+    if (!out.good()) {
+        std::fprintf(stderr, "Failed to append to %s\n", dictPath.string().c_str());
+        return WBK_WRITE_ERROR;
+    }
+    std::printf("Appended %zu names to %s\n", fresh.size(), dictPath.string().c_str());
+    return 0;
 }
 
 // ---------------------------
@@ -132,35 +615,97 @@ int main(int argc, char** argv)
     // Simple usage guard (kept from your original, adjusted to show -d)
     if (argc < 3 || argc >  nine /*remove this placeholder and keep the block below*/) {}
 
-    // Real usage guard
-    if (argc < 3 || argc > 11) {
+    // Real usage guard; -crack and -find take any number of banks/queries, the other modes a fixed set
+    const bool variadicMode = argc >= 2 && (std::strcmp(argv[1], "-crack") == 0 || std::strcmp(argv[1], "-find") == 0);
+    if (argc < 3 || (!variadicMode && argc > 20)) {
         std::printf("Usage:\n");
-        std::printf("  %s -e <.wbk> <output_folder> [-h] [-n] [-d <dict.txt>]\n", argv[0]);
-        std::printf("  %s -r <.wbk> <index|0xHASH|name|folder> <replacement.wav (if single)> [-h] [-n] [-d <dict.txt>] [-c <codec>]\n", argv[0]);
+        std::printf("  %s -e <.wbk> <output_folder> [-h] [-n] [-d <dict.txt>] [-j <threads>] [-m <MB>] [--stats] [--trace <file>]\n", argv[0]);
+        std::printf("  %s -r <.wbk> <index|0xHASH|name|folder> <replacement.wav (if single)> [-h] [-n] [-d <dict.txt>] [-c <codec>] [-j <threads>] [-q <preset>] [--snr] [--keep-offsets] [--in-place] [--dedupe] [--stats] [--trace <file>]\n", argv[0]);
+        std::printf("  %s -be <folder|banks.txt> <output_root> [-h] [-n] [-d <dict.txt>] [-j <threads>] [-m <MB>] [--stats] [--trace <file>]\n", argv[0]);
+        std::printf("  %s -br <folder|banks.txt> <replacement_root> [-h] [-n] [-d <dict.txt>] [-c <codec>] [-j <threads>] [-q <preset>] [--keep-offsets] [--in-place] [--dedupe] [--stats] [--trace <file>]\n", argv[0]);
+        std::printf("  %s -D <dict.txt> <dict.wbkdict>\n", argv[0]);
+        std::printf("  %s -catalog <folder|banks.txt> <catalog.wbkcat> [-j <threads>]\n", argv[0]);
+        std::printf("  %s -find <catalog.wbkcat> <0xHASH|name> [more ...] [-d <dict.txt>]\n", argv[0]);
+        std::printf("  %s -crack <template|@templates.txt> <.wbk> [more .wbk ...] [-d <dict.txt>] [-j <threads>]\n", argv[0]);
         std::printf("\nOptions:\n");
         std::printf("  -h           Treat indices as raw 32-bit hashes (and name extracted files as 0xHASH.wav)\n");
         std::printf("  -n           Resolve string names via dictionary; for single replace, treat 3rd arg as NAME\n");
-        std::printf("  -d <file>    Path to string_hash_dictionary.txt (one name per line)\n");
+        std::printf("  -d <file>    Path to string_hash_dictionary.txt (one name per line) or a dictionary compiled with -D\n");
         std::printf("  -c <codec>   Set codec when replacing: 1=PCM, 2=PCM2, 4=ADPCM_1, 5=ADPCM_2, 7=IMA_ADPCM (others reserved)\n");
+        std::printf("  -j <threads> Worker threads for extraction, folder replace and single ADPCM_1/ADPCM_2 encodes (default: all cores)\n");
+        std::printf("  -m <MB>      Extraction chunk budget; each worker decodes through a chunk of MB / threads (default: 256)\n");
+        std::printf("  -q <preset>  ADPCM_1 encoder preset: fast, normal or exhaustive (default)\n");
+        std::printf("  --snr        Single ADPCM_1 replace: compare SNR of the parallel (-j) and serial encoders\n");
+        std::printf("  --keep-offsets  Keep payload offsets when a replacement fits its slot; only larger ones move to the end\n");
+        std::printf("  --in-place   Like --keep-offsets, but patch the changed bytes into <.wbk> instead of writing .new.wbk\n");
+        std::printf("  --dedupe     Store byte-identical payloads once and report the bytes saved\n");
+        std::printf("  --stats      Print per-phase/per-codec timings, bytes, samples and the peak RSS when done\n");
+        std::printf("  --trace <f>  Write a Chrome trace JSON of all timed phases to <f>\n");
         return -1;
     }
 
     bool extract = false;
+    bool crack = false;
+    bool batch = false;
+    bool catalogMode = false;
+    bool findMode = false;
     bool hashSearch = false;     // interpret arg3 as hash for single replace; use 0xHASH filenames on extract
     bool resolveHashes = false;  // use dictionary to resolve names for extract/replace
+    bool reportSnr = false;
+    bool reportStats = false;
+    bool inPlace = false;
+    bool dedupe = false;
+    WBK::Layout layout = WBK::Layout::Compact;
+    fs::path tracePath;
     fs::path dictPath;
+    unsigned numThreads = default_thread_count();
+    size_t maxPcmBytes = size_t(256) << 20;
+
+    // Compile a text dictionary into the binary index -d loads without parsing
+    if (std::strcmp(argv[1], "-D") == 0) {
+        if (argc != 4 || !load_dictionary(argv[2]))
+            return -1;
+        if (!g_dictionary.compile(argv[3])) {
+            std::fprintf(stderr, "Failed to write %s\n", argv[3]);
+            return WBK_WRITE_ERROR;
+        }
+        std::printf("Compiled %zu names to %s\n", g_dictionary.size(), argv[3]);
+        return 0;
+    }
 
     // Quick mode detection and parsing of the positional part
-    if (std::strstr(argv[1], "-e")) {
+    if (std::strcmp(argv[1], "-crack") == 0) {
+        crack = true;
+    }
+    else if (std::strcmp(argv[1], "-catalog") == 0) {
+        catalogMode = true;
+        if (argc < 4) {
+            std::printf("Missing <catalog.wbkcat> for -catalog.\n");
+            return -1;
+        }
+    }
+    else if (std::strcmp(argv[1], "-find") == 0) {
+        findMode = true;
+    }
+    else if (std::strcmp(argv[1], "-be") == 0 || std::strcmp(argv[1], "-br") == 0) {
+        batch = true;
+        extract = argv[1][2] == 'e';
+        if (argc < 4) {
+            std::printf("Missing <output_root|replacement_root> for batch mode.\n");
+            return -1;
+        }
+    }
+    else if (std::strstr(argv[1], "-e")) {
         extract = true;
     }
     else if (!std::strstr(argv[1], "-r")) {
-        std::printf("Invalid mode. Use -e or -r.\n");
+        std::printf("Invalid mode. Use -e, -r, -be, -br, -D, -crack, -catalog or -find.\n");
         return -1;
     }
 
     // Options parse
     WBK::Codec codec = WBK::Keep;
+    EncodeOptions encodeOptions;
     for (int i = 1; i < argc; ++i) {
         if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
             int codecType = std::atoi(argv[i + 1]);
@@ -172,6 +717,25 @@ int main(int argc, char** argv)
                 return -1;
             }
         }
+        else if (std::strcmp(argv[i], "--snr") == 0) {
+            reportSnr = true;
+        }
+        else if (std::strcmp(argv[i], "--keep-offsets") == 0) {
+            layout = WBK::Layout::KeepOffsets;
+        }
+        else if (std::strcmp(argv[i], "--in-place") == 0) {
+            inPlace = true;
+            layout = WBK::Layout::KeepOffsets;
+        }
+        else if (std::strcmp(argv[i], "--dedupe") == 0) {
+            dedupe = true;
+        }
+        else if (std::strcmp(argv[i], "--stats") == 0) {
+            reportStats = true;
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = fs::path(argv[i + 1]);
+        }
         else if (std::strcmp(argv[i], "-h") == 0) {
             hashSearch = true;
         }
@@ -182,10 +746,67 @@ int main(int argc, char** argv)
         else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
             dictPath = fs::path(argv[i + 1]);
         }
+        else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            int n = std::atoi(argv[i + 1]);
+            if (n <= 0) {
+                std::printf("Invalid thread count specified!\n");
+                return -1;
+            }
+            numThreads = (unsigned)n;
+            encodeOptions.threads = numThreads;
+        }
+        else if (std::strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            std::string preset = to_lower_copy(argv[i + 1]);
+            if (preset == "fast")
+                encodeOptions.adpcm1_quality = Adpcm1Quality::Fast;
+            else if (preset == "normal")
+                encodeOptions.adpcm1_quality = Adpcm1Quality::Normal;
+            else if (preset == "exhaustive")
+                encodeOptions.adpcm1_quality = Adpcm1Quality::Exhaustive;
+            else {
+                std::printf("Invalid encoder preset specified!\n");
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            long long mb = std::atoll(argv[i + 1]);
+            if (mb <= 0) {
+                std::printf("Invalid memory cap specified!\n");
+                return -1;
+            }
+            maxPcmBytes = size_t(mb) << 20;
+        }
+    }
+
+    // Instrumentation, reported on every way out of main
+    if (reportStats || !tracePath.empty())
+        g_trace.enable(/*keep_events=*/!tracePath.empty());
+    struct trace_report_t {
+        bool stats;
+        fs::path trace;
+        ~trace_report_t() {
+            if (stats)
+                g_trace.print_stats(stdout);
+            if (!trace.empty() && !g_trace.write_chrome_trace(trace))
+                std::fprintf(stderr, "Failed to write %s\n", trace.string().c_str());
+        }
+    } trace_report{ reportStats, tracePath };
+
+    if (crack)
+        return crack_hashes(argc, argv, dictPath, numThreads);
+    if (catalogMode)
+        return update_catalog(argv[2], argv[3], numThreads);
+    if (findMode) {
+        // names are hashed directly; a dictionary only adds names to the output
+        if (!dictPath.empty())
+            load_dictionary(dictPath);
+        return find_in_catalog(argc, argv);
     }
 
     // Load dictionary if requested
     if (resolveHashes) {
+        if (dictPath.empty() && fs::exists("string_hash_dictionary.txt"))
+            dictPath = "string_hash_dictionary.txt";
         if (dictPath.empty()) {
             std::fprintf(stderr, "Warning: -n provided but no -d <dict.txt>. I will still hash names directly.\n");
         }
@@ -196,36 +817,37 @@ int main(int argc, char** argv)
         }
     }
 
-    WBK wbk;
+    // settings for the per-track jobs; tracks stream through a fixed chunk per worker, so -m bounds
+    // the decoded PCM in flight, and they are already spread over the workers, so each one is encoded serially
+    track_options_t trackOptions;
+    trackOptions.hashSearch = hashSearch;
+    trackOptions.resolveHashes = resolveHashes;
+    trackOptions.codec = codec;
+    trackOptions.encodeOptions = encodeOptions;
+    trackOptions.encodeOptions.threads = 1;
+    trackOptions.chunkSamples = std::max<size_t>(4096, maxPcmBytes / std::max(1u, numThreads) / sizeof(int16_t));
 
-    // Helper that decides filename for a given entry index
-    auto make_filename = [&wbk, &resolveHashes](bool hash, int i) {
-        const auto& e = wbk.entries[i];
-        if (hash) {
-            if (resolveHashes) {
-                auto hname = lookup_string_by_hash(e.hash);
-                if (!hname.empty())
-                    return std::format("{}.wav", hname);
-            }
-            return std::format("0x{:08x}.wav", e.hash);
-        }
-        else {
-            return std::format("{}.wav", i);
-        }
-        };
+    const bank_options_t bankOptions{ layout, dedupe, inPlace };
+    if (batch)
+        return run_batch(extract, argv[2], argv[3], trackOptions, bankOptions, numThreads);
+
+    WBK wbk;
 
     if (extract) {
-        if (wbk.read(argv[2]) != WBK_OK) return WBK_PARSE_FAILED;
+        // tracks are decoded by the workers, one entry at a time
+        if (wbk.read(argv[2], /*DecodeTracks=*/false) != WBK_OK) return WBK_PARSE_FAILED;
 
         auto base_path = std::string(argv[3]);
         if (!fs::exists(base_path)) fs::create_directories(base_path);
 
-        for (size_t i = 0; i < wbk.tracks.size(); ++i) {
-            auto name = make_filename(hashSearch, (int)i);
-            fs::path out = fs::path(base_path) / name;
-            const auto& entry = wbk.entries[i];
-            std::vector<int16_t>& pcm = wbk.tracks[i];
-            WAV::writeWAV(out.string(), pcm, entry.samples_per_second, WBK::GetNumChannels(entry));
+        std::atomic<size_t> failed = 0;
+        parallel_for(wbk.entries.size(), numThreads, [&](size_t i) {
+            if (!extract_track(wbk, (int)i, base_path, trackOptions))
+                failed++;
+        });
+        if (failed > 0) {
+            std::fprintf(stderr, "%zu of %zu tracks failed\n", size_t(failed), wbk.entries.size());
+            return WBK_WRITE_ERROR;
         }
         return 1;
     }
@@ -236,6 +858,7 @@ int main(int argc, char** argv)
     if (wbk.read(argv[2], /*load_samples=*/false) != WBK_OK) return WBK_PARSE_FAILED;
 
     bool modified = false;
+    WBK::dedupe_stats_t dedupeStats;
     fs::path third = argv[3];
     int replace_idx = -1;
     fs::path replace_path;
@@ -244,48 +867,37 @@ int main(int argc, char** argv)
     if (fs::exists(third) && fs::is_directory(third)) {
         replace_path = third;
         int successes = 0;
-
-        for (int i = 0; i < (int)wbk.entries.size(); ++i) {
-            const auto& e = wbk.entries[i];
-            // Candidate filenames to look up
-            std::vector<fs::path> candidates;
-            candidates.emplace_back(replace_path / std::format("{}.wav", i)); // index.wav
-
-            if (hashSearch) {
-                if (resolveHashes) {
-                    auto nice = lookup_string_by_hash(e.hash);
-                    if (!nice.empty())
-                        candidates.emplace_back(replace_path / std::format("{}.wav", nice)); // name.wav
-                }
-                candidates.emplace_back(replace_path / std::format("0x{:08x}.wav", e.hash)); // 0xHASH.wav
-            }
-
-            bool done = false;
-            for (const auto& wav_file : candidates) {
-                if (!fs::exists(wav_file)) continue;
-
-                WAV wav;
-                if (!wav.readWAV(wav_file.string())) {
-                    std::fprintf(stderr, "Failed to parse WAV: %s\n", wav_file.string().c_str());
-                    continue;
-                }
-                if (wbk.replace(i, wav, codec) == WBK_OK) {
-                    std::printf("Replaced index %d (%s)\n", i, wav_file.filename().string().c_str());
-                    modified = true;
-                    successes++;
-                    done = true;
-                    break;
-                }
-                else {
-                    std::fprintf(stderr, "Replace failed for %s\n", wav_file.string().c_str());
-                }
+        WBK::ReplacePlan plan(wbk, trackOptions.encodeOptions);
+        plan.layout = layout;
+        plan.dedupe = dedupe;
+
+        // read and encode every matching WAV on the worker threads
+        std::vector<staged_track_t> results(wbk.entries.size());
+        std::mutex plan_lock;
+        parallel_for(wbk.entries.size(), numThreads, [&](size_t i) {
+            results[i] = stage_replacement(plan, plan_lock, wbk, (int)i, replace_path, trackOptions);
+        });
+
+        for (int i = 0; i < (int)results.size(); ++i) {
+            for (const auto& error : results[i].errors)
+                std::fprintf(stderr, "%s\n", error.c_str());
+
+            if (results[i].done) {
+                std::printf("Replaced index %d (%s)\n", i, results[i].wav_file.filename().string().c_str());
+                successes++;
             }
-            if (!done) {
+            else {
                 // Not fatal; just report missing
                 std::printf("No replacement for index %d\n", i);
             }
         }
 
+        // lay out the bank once for all staged replacements
+        if (wbk.replace(plan, &dedupeStats) == WBK_OK)
+            modified = !plan.empty() || dedupeStats.shared_entries > 0;
+        else
+            std::fprintf(stderr, "Replace failed for %s\n", replace_path.string().c_str());
+
         std::printf("Replaced %d/%zu entries\n", successes, wbk.entries.size());
     }
     else {
@@ -306,8 +918,7 @@ int main(int argc, char** argv)
             uint32_t target_hash = 0;
             if (resolveHashes) {
                 // Treat arg as a NAME (hash via engine hash; dict helps only for nicer naming)
-                auto maybe = lookup_hash_by_name(argv[3]);
-                target_hash = maybe.value(); // always produced even if not in dict
+                target_hash = lookup_hash_by_name(argv[3]);
             }
             else {
                 // Expect 0xHASH or decimal
@@ -337,7 +948,22 @@ int main(int argc, char** argv)
             std::printf("This WAV failed to parse\n");
             return -1;
         }
-        if (wbk.replace(replace_idx, wav, codec) == WBK_OK) {
+        if (reportSnr && (codec == WBK::Keep ? wbk.entries[replace_idx].codec : codec) == WBK::ADPCM_1) {
+            const auto pcm = wav.pcm();
+            const int ch = wav.header.numChannels ? wav.header.numChannels : 1;
+
+            auto serial = EncodeAdpcm1(std::span<const int16_t>(pcm), ch, encodeOptions.adpcm1_quality);
+            auto segmented = EncodeAdpcm1Segmented(pcm, ch, encodeOptions.adpcm1_quality, encodeOptions.threads, 0, encodeOptions.seam_frames);
+            const double snr_serial = Adpcm1Snr(pcm, ch, serial);
+            const double snr_segmented = Adpcm1Snr(pcm, ch, segmented);
+            std::printf("ADPCM_1 SNR: serial %.3f dB, %u threads %.3f dB (delta %+.3f dB)\n",
+                snr_serial, encodeOptions.threads, snr_segmented, snr_segmented - snr_serial);
+        }
+
+        WBK::ReplacePlan plan(wbk, encodeOptions);
+        plan.layout = layout;
+        plan.dedupe = dedupe;
+        if (plan.add(replace_idx, wav, codec) == WBK_OK && wbk.replace(plan, &dedupeStats) == WBK_OK) {
             modified = true;
             std::printf("Replaced index %d\n", replace_idx);
         }
@@ -346,11 +972,12 @@ int main(int argc, char** argv)
         }
     }
 
+    if (dedupe)
+        std::printf("Deduplicated %d entries, saved %zu bytes\n", dedupeStats.shared_entries, dedupeStats.bytes_saved);
+
     if (modified) {
-        fs::path out = fs::path(std::string(argv[2])).replace_extension(".new.wbk");
-        wbk.write(out);
-        std::printf("Written to %s\n", out.string().c_str());
-        return 1;
+        const int res = write_replaced_bank(wbk, argv[2], bankOptions);
+        return res == WBK_OK ? 1 : res;
     }
     return 0;
 }